@@ -15,6 +15,9 @@ void ofApp::setup() {
 	// or by device name
 	//camera.setup("Fuji Fujifilm X-T2");
 
+	// or bind it to one body on a rig with identical cameras
+	//camera.setupBySerial("3271234");
+
 	// start live view
 	camera.setLiveView(true);
 }
@@ -57,6 +60,10 @@ void ofApp::keyPressed(int key) {
 	if(key == 'l') {
 		camera.setLiveView(!camera.isLiveView());
     }
+	if(key == 't') {
+		// also download photos taken with the camera's shutter button
+		camera.setTetherMode(!camera.isTetherMode());
+	}
     if(key == 'c') {
         camera.close();
     }
@@ -0,0 +1,509 @@
+#include "CameraRig.h"
+
+/*
+ How far in the future the synchronized trigger fires once every camera
+ thread has arrived at the barrier. It covers the time it takes the last
+ thread to wake up, after that they all spin towards the same instant.
+ */
+#define OFX_GPHOTO_TRIGGER_MARGIN_MICROS 2000
+
+// Default live view budget per USB bus, about what USB 2.0 sustains in practice.
+#define OFX_GPHOTO_DEFAULT_BUS_BUDGET (30 << 20)
+
+namespace ofxGphoto {
+
+	/*
+	 Releases all threads at once and hands them a common point in time to fire
+	 at. Condition variable wakeups are too sloppy to fire on, so the threads
+	 busy-wait for the last stretch.
+	 */
+	class TriggerBarrier {
+	public:
+		typedef CaptureScheduler::Clock Clock;
+		TriggerBarrier(size_t count) :
+		count(count),
+		released(false) {
+		}
+		Clock::time_point arrive() {
+			unique_lock<std::mutex> lock(barrierMutex);
+			if(--count == 0) {
+				fireTime = Clock::now() + chrono::microseconds(OFX_GPHOTO_TRIGGER_MARGIN_MICROS);
+				released = true;
+				allArrived.notify_all();
+			} else {
+				allArrived.wait(lock, [this] { return released; });
+			}
+			return fireTime;
+		}
+	protected:
+		std::mutex barrierMutex;
+		condition_variable allArrived;
+		size_t count;
+		bool released;
+		Clock::time_point fireTime;
+	};
+
+	// "usb:001,005" is device 5 on bus 1, anything that isn't usb is its own bus
+	static string getBus(const string& port) {
+		if(port.compare(0, 4, "usb:") == 0) {
+			return port.substr(0, port.find(','));
+		}
+		return port;
+	}
+
+	CameraRig::CameraRig() :
+	busBudget(OFX_GPHOTO_DEFAULT_BUS_BUDGET),
+	atlas(false),
+	dctDownscale(true),
+	tileWidth(0),
+	tileHeight(0),
+	columns(0),
+	atlasDirty(false),
+	running(false),
+	startTime(0),
+	shutdownSeconds(0) {
+	}
+
+	void CameraRig::setBusBudget(float bytesPerSecond) {
+		unique_lock<std::mutex> lock(sessionMutex);
+		busBudget = bytesPerSecond;
+	}
+
+	float CameraRig::getBusBudget() const {
+		return busBudget;
+	}
+
+	void CameraRig::setWorkerThreadSettings(const ThreadSettings& settings) {
+		if(running) {
+			ofLogWarning("ofxGphoto::CameraRig") << "setWorkerThreadSettings() has to be called before setup()";
+			return;
+		}
+		workerThreadSettings = settings;
+	}
+
+	CameraRig::~CameraRig() {
+		close();
+	}
+
+	GPhoto& CameraRig::addSession() {
+		if(running) {
+			ofLogError("ofxGphoto::CameraRig") << "add cameras before calling setup()";
+		}
+		sessions.push_back(Session());
+		Session& session = sessions.back();
+		session.camera.reset(new GPhoto());
+		session.camera->setUseOwnThread(false);
+		session.inFlight = false;
+		session.liveFrames = 0;
+		session.photoPending = false;
+		session.liveView = false;
+		session.bytesPerFrame = 0;
+		session.stats = RigCameraStats();
+		return *session.camera;
+	}
+
+	GPhoto& CameraRig::addCamera(int id) {
+		GPhoto& camera = addSession();
+		camera.setup(id);
+		sessions.back().stats.bus = getBus(camera.getCameraInformation().port);
+		return camera;
+	}
+
+	GPhoto& CameraRig::addCamera(string value, MatchBy matchBy) {
+		GPhoto& camera = addSession();
+		camera.setup(value, matchBy);
+		sessions.back().stats.bus = getBus(camera.getCameraInformation().port);
+		return camera;
+	}
+
+	int CameraRig::addAllCameras() {
+		GPhoto lister;
+		auto devices = lister.listDevices(false);
+		for(auto& d:devices) {
+			addCamera(d.port, MATCH_PORT);
+		}
+		return devices.size();
+	}
+
+	void CameraRig::setup(int numWorkers) {
+		if(running) {
+			return;
+		}
+		running = true;
+		startTime = ofGetElapsedTimef();
+		for(auto& session:sessions) {
+			session.nextPoll = session.nextLiveView = Clock::now();
+			session.camera->setPolling(true);
+		}
+		for(int i = 0; i < max(numWorkers, 1); i++) {
+			workers.emplace_back(&CameraRig::workerLoop, this);
+		}
+		ofLogNotice("ofxGphoto::CameraRig") << sessions.size() << " cameras on " << workers.size() << " workers";
+	}
+
+	void CameraRig::update() {
+		if(atlas) {
+			lock_guard<std::mutex> lock(atlasMutex);
+			if(atlasDirty) {
+				atlasTexture.loadData(atlasPixels);
+				atlasDirty = false;
+			}
+			return;
+		}
+		for(auto& session:sessions) {
+			session.camera->update();
+		}
+	}
+
+	/*
+	 Cancels whatever the cameras are doing before joining the workers, then
+	 closes all cameras at once, so restarting a rig takes as long as the
+	 slowest camera rather than the sum of them.
+	 */
+	void CameraRig::close() {
+		float closeStart = ofGetElapsedTimef();
+		{
+			unique_lock<std::mutex> lock(sessionMutex);
+			running = false;
+		}
+		for(auto& session:sessions) {
+			session.camera->requestStop();
+		}
+		sessionDone.notify_all();
+		for(auto& worker:workers) {
+			worker.join();
+		}
+		workers.clear();
+		vector<std::thread> closing;
+		for(auto& session:sessions) {
+			session.camera->setPolling(false);
+			closing.emplace_back(&GPhoto::close, session.camera.get());
+		}
+		for(auto& t:closing) {
+			t.join();
+		}
+		sessions.clear();
+		shutdownSeconds = ofGetElapsedTimef() - closeStart;
+		ofLogVerbose("ofxGphoto::CameraRig") << "close took " << shutdownSeconds * 1000 << " ms";
+	}
+
+	float CameraRig::getShutdownSeconds() const {
+		return shutdownSeconds;
+	}
+
+	size_t CameraRig::size() const {
+		return sessions.size();
+	}
+
+	GPhoto& CameraRig::getCamera(size_t i) {
+		return *sessions[i].camera;
+	}
+
+	GPhoto& CameraRig::operator[](size_t i) {
+		return getCamera(i);
+	}
+
+	/*
+	 Takes every camera away from the worker pool, waiting for in-flight polls to
+	 finish, then fires them all from their own threads at the same instant.
+	 The triggered files are picked up by the normal capture loop once the
+	 cameras are handed back to the pool.
+	 */
+	TriggerResult CameraRig::trigger() {
+		TriggerResult result;
+		result.results.assign(sessions.size(), GP_ERROR_IO);
+		result.issueSkewMs.assign(sessions.size(), 0);
+		result.completeSkewMs.assign(sessions.size(), 0);
+		result.maxIssueSkewMs = result.maxCompleteSkewMs = 0;
+
+		{
+			unique_lock<std::mutex> lock(sessionMutex);
+			for(auto& session:sessions) {
+				sessionDone.wait(lock, [&] { return !session.inFlight; });
+				session.inFlight = true;
+			}
+		}
+
+		vector<size_t> armed;
+		for(size_t i = 0; i < sessions.size(); i++) {
+			if(sessions[i].camera->isConnected()) {
+				armed.push_back(i);
+			}
+		}
+
+		vector<Clock::time_point> issued(sessions.size()), completed(sessions.size());
+		TriggerBarrier barrier(armed.size());
+		vector<thread> triggers;
+		for(size_t i:armed) {
+			triggers.emplace_back([&, i] {
+				Clock::time_point fireTime = barrier.arrive();
+				while(Clock::now() < fireTime) {
+				}
+				issued[i] = Clock::now();
+				result.results[i] = sessions[i].camera->triggerCapture();
+				completed[i] = Clock::now();
+			});
+		}
+		for(auto& t:triggers) {
+			t.join();
+		}
+
+		if(!armed.empty()) {
+			Clock::time_point firstIssued = issued[armed[0]], firstCompleted = completed[armed[0]];
+			for(size_t i:armed) {
+				firstIssued = min(firstIssued, issued[i]);
+				firstCompleted = min(firstCompleted, completed[i]);
+			}
+			for(size_t i:armed) {
+				result.issueSkewMs[i] = chrono::duration<float, milli>(issued[i] - firstIssued).count();
+				result.completeSkewMs[i] = chrono::duration<float, milli>(completed[i] - firstCompleted).count();
+				result.maxIssueSkewMs = max(result.maxIssueSkewMs, result.issueSkewMs[i]);
+				result.maxCompleteSkewMs = max(result.maxCompleteSkewMs, result.completeSkewMs[i]);
+			}
+		}
+
+		{
+			unique_lock<std::mutex> lock(sessionMutex);
+			for(auto& session:sessions) {
+				session.inFlight = false;
+				session.nextPoll = Clock::now();
+			}
+		}
+		sessionDone.notify_all();
+		ofLogVerbose("ofxGphoto::CameraRig") << "triggered " << armed.size() << " cameras, skew " << result.maxCompleteSkewMs << " ms";
+		return result;
+	}
+
+	void CameraRig::setupAtlas(int tileWidth, int tileHeight, int columns, bool dctDownscale) {
+		if(columns <= 0) {
+			columns = ceil(sqrt((float) max(sessions.size(), (size_t) 1)));
+		}
+		int rows = (max(sessions.size(), (size_t) 1) + columns - 1) / columns;
+		lock_guard<std::mutex> lock(atlasMutex);
+		this->tileWidth = tileWidth;
+		this->tileHeight = tileHeight;
+		this->columns = columns;
+		this->dctDownscale = dctDownscale;
+		atlasPixels.allocate(tileWidth * columns, tileHeight * rows, OF_IMAGE_COLOR);
+		atlasPixels.set(0);
+		atlasTexture.allocate(atlasPixels.getWidth(), atlasPixels.getHeight(), GL_RGB8);
+		atlasDirty = true;
+		for(auto& session:sessions) {
+			session.tileContent = ofRectangle();
+		}
+		atlas = true;
+	}
+
+	bool CameraRig::isAtlas() const {
+		return atlas;
+	}
+
+	ofRectangle CameraRig::getTileRect(size_t i) {
+		lock_guard<std::mutex> lock(atlasMutex);
+		if(sessions[i].tileContent.width > 0) {
+			return sessions[i].tileContent;
+		}
+		return ofRectangle((i % columns) * tileWidth, (i / columns) * tileHeight, tileWidth, tileHeight);
+	}
+
+	const ofTexture& CameraRig::getAtlasTexture() const {
+		return atlasTexture;
+	}
+
+	void CameraRig::drawAtlas(float x, float y) {
+		atlasTexture.draw(x, y, atlasTexture.getWidth(), atlasTexture.getHeight());
+	}
+
+	void CameraRig::drawTile(size_t i, float x, float y, float width, float height) {
+		ofRectangle tile = getTileRect(i);
+		atlasTexture.drawSubsection(x, y, width, height, tile.x, tile.y, tile.width, tile.height);
+	}
+
+	/*
+	 Runs on the worker that just polled camera i. The jpeg is decoded with
+	 FreeImage, asking libjpeg for at least the tile size so it can do the
+	 cheap DCT downscale, then fitted into the tile keeping its aspect ratio.
+	 FreeImage keeps its rows bottom-up and in BGR order.
+	 */
+	void CameraRig::decodeIntoTile(size_t i) {
+		Session& session = sessions[i];
+		if(!session.camera->popLiveFrame(session.liveFrame)) {
+			return;
+		}
+
+		int flags = JPEG_FAST;
+		if(dctDownscale) {
+			flags |= max(tileWidth, tileHeight) << 16;
+		}
+		FIMEMORY *memory = FreeImage_OpenMemory((BYTE*) session.liveFrame.getData(), session.liveFrame.size());
+		FIBITMAP *bitmap = FreeImage_LoadFromMemory(FIF_JPEG, memory, flags);
+		FreeImage_CloseMemory(memory);
+		if(!bitmap) {
+			ofLogWarning("ofxGphoto::CameraRig") << "cannot decode live frame of camera " << i;
+			return;
+		}
+
+		float scale = min((float) tileWidth / FreeImage_GetWidth(bitmap), (float) tileHeight / FreeImage_GetHeight(bitmap));
+		int width = max(1, (int) (FreeImage_GetWidth(bitmap) * scale));
+		int height = max(1, (int) (FreeImage_GetHeight(bitmap) * scale));
+		if(width != (int) FreeImage_GetWidth(bitmap) || height != (int) FreeImage_GetHeight(bitmap)) {
+			FIBITMAP *scaled = FreeImage_Rescale(bitmap, width, height, FILTER_BILINEAR);
+			FreeImage_Unload(bitmap);
+			bitmap = scaled;
+		}
+		if(bitmap && FreeImage_GetBPP(bitmap) != 24) {
+			FIBITMAP *converted = FreeImage_ConvertTo24Bits(bitmap);
+			FreeImage_Unload(bitmap);
+			bitmap = converted;
+		}
+		if(!bitmap) {
+			return;
+		}
+
+		int tileX = (i % columns) * tileWidth;
+		int tileY = (i / columns) * tileHeight;
+		ofRectangle content(tileX + (tileWidth - width) / 2, tileY + (tileHeight - height) / 2, width, height);
+		size_t stride = atlasPixels.getWidth() * 3;
+
+		lock_guard<std::mutex> lock(atlasMutex);
+		unsigned char *atlasData = atlasPixels.getData();
+		if(content.width != session.tileContent.width || content.height != session.tileContent.height) {
+			// the picture changed size, clear the letterbox
+			for(int y = tileY; y < tileY + tileHeight; y++) {
+				memset(atlasData + y * stride + tileX * 3, 0, tileWidth * 3);
+			}
+			session.tileContent = content;
+		}
+		for(int y = 0; y < height; y++) {
+			const BYTE *src = FreeImage_GetScanLine(bitmap, height - 1 - y);
+			unsigned char *dst = atlasData + (size_t) (content.y + y) * stride + (size_t) content.x * 3;
+			for(int x = 0; x < width; x++) {
+				dst[0] = src[FI_RGBA_RED];
+				dst[1] = src[FI_RGBA_GREEN];
+				dst[2] = src[FI_RGBA_BLUE];
+				dst += 3;
+				src += 3;
+			}
+		}
+		atlasDirty = true;
+		FreeImage_Unload(bitmap);
+	}
+
+	RigCameraStats CameraRig::getCameraStats(size_t i) {
+		RigCameraStats stats;
+		{
+			unique_lock<std::mutex> lock(sessionMutex);
+			stats = sessions[i].stats;
+		}
+		stats.frameRate = sessions[i].camera->getFrameRate();
+		stats.bandwidth = sessions[i].camera->getBandwidth();
+		return stats;
+	}
+
+	RigStats CameraRig::getStats() {
+		RigStats stats = RigStats();
+		for(size_t i = 0; i < sessions.size(); i++) {
+			RigCameraStats camera = getCameraStats(i);
+			stats.polls += camera.polls;
+			stats.busySeconds += camera.busySeconds;
+			stats.frameRate += camera.frameRate;
+			stats.bandwidth += camera.bandwidth;
+		}
+		float elapsed = (ofGetElapsedTimef() - startTime) * workers.size();
+		stats.utilization = elapsed > 0 ? stats.busySeconds / elapsed : 0;
+		return stats;
+	}
+
+	// called with sessionMutex held
+	bool CameraRig::isLiveViewAllowed(const Session& session, Clock::time_point now) const {
+		if(now < session.nextLiveView) {
+			return false;
+		}
+		// photos first, a download competing with previews would crawl
+		for(auto& other:sessions) {
+			if(other.photoPending && other.stats.bus == session.stats.bus) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// called with sessionMutex held after every poll
+	void CameraRig::scheduleLiveView(Session& session, Clock::time_point pollStart, bool gotFrame) {
+		session.stats.targetFrameRate = 0;
+		if(busBudget <= 0 || session.bytesPerFrame <= 0) {
+			return;
+		}
+		unsigned int streaming = 0;
+		for(auto& other:sessions) {
+			if(other.liveView && other.stats.bus == session.stats.bus) {
+				streaming++;
+			}
+		}
+		float share = busBudget / max(streaming, 1u);
+		session.stats.targetFrameRate = share / session.bytesPerFrame;
+		if(gotFrame) {
+			float interval = session.bytesPerFrame / share;
+			session.nextLiveView = pollStart + chrono::duration_cast<Clock::duration>(chrono::duration<float>(interval));
+		}
+	}
+
+	/*
+	 Takes the most overdue camera that no other worker is handling, runs one
+	 capture loop iteration on it and asks it when it wants to be polled again.
+	 If nothing is due, sleeps until the earliest camera is. Whether the
+	 iteration may fetch a live frame is decided by the bus budget.
+	 */
+	void CameraRig::workerLoop() {
+		if(!workerThreadSettings.isDefault()) {
+			applyThreadSettings(workerThreadSettings, "ofxGphoto::CameraRig worker");
+		}
+		unique_lock<std::mutex> lock(sessionMutex);
+		while(running) {
+			Session *next = nullptr;
+			Clock::time_point earliest = Clock::now() + chrono::milliseconds(5);
+			for(auto& session:sessions) {
+				if(!session.inFlight && session.nextPoll < earliest) {
+					earliest = session.nextPoll;
+					next = &session;
+				}
+			}
+			if(!next || next->nextPoll > Clock::now()) {
+				sessionDone.wait_until(lock, earliest);
+				continue;
+			}
+
+			next->inFlight = true;
+			Clock::time_point pollStart = Clock::now();
+			bool allowLiveView = isLiveViewAllowed(*next, pollStart);
+			lock.unlock();
+			GPhoto& camera = *next->camera;
+			camera.poll(allowLiveView);
+			Clock::time_point nextPoll = camera.getNextPollTime();
+			float busySeconds = chrono::duration<float>(Clock::now() - pollStart).count();
+			unsigned int liveFrames = camera.getLiveFrameCount();
+			bool photoPending = camera.hasPendingPhotoWork();
+			bool liveView = camera.isLiveView() && camera.isConnected();
+			float bytesPerFrame = camera.getBytesPerFrame();
+			lock.lock();
+
+			next->nextPoll = nextPoll;
+			next->photoPending = photoPending;
+			next->liveView = liveView;
+			next->bytesPerFrame = bytesPerFrame;
+			scheduleLiveView(*next, pollStart, liveFrames != next->liveFrames);
+			next->liveFrames = liveFrames;
+			next->stats.polls++;
+			next->stats.busySeconds += busySeconds;
+
+			if(atlas) {
+				// still ours until inFlight is cleared, so decode without holding the lock
+				lock.unlock();
+				decodeIntoTile(next - &sessions[0]);
+				lock.lock();
+			}
+			next->inFlight = false;
+			sessionDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "ofxGphoto.h"
+
+namespace ofxGphoto {
+
+	struct RigCameraStats {
+		unsigned int polls; // capture loop iterations run for this camera
+		float busySeconds; // worker time spent on this camera
+		float frameRate; // live view frames per second
+		float bandwidth; // live view bytes per second
+		float targetFrameRate; // what the bus budget allows this camera, 0 if unlimited
+		string bus;
+	};
+
+	struct RigStats {
+		unsigned int polls;
+		float busySeconds;
+		float utilization; // busy time / (workers * running time)
+		float frameRate;
+		float bandwidth;
+	};
+
+	/*
+	 Outcome of CameraRig::trigger(), one entry per camera. Skews are measured
+	 against the earliest camera: issue is when gp_camera_trigger_capture was
+	 called, complete is when it returned.
+	 */
+	struct TriggerResult {
+		vector<int> results; // gphoto result per camera
+		vector<float> issueSkewMs;
+		vector<float> completeSkewMs;
+		float maxIssueSkewMs;
+		float maxCompleteSkewMs;
+	};
+
+	/*
+	 CameraRig owns many GPhoto sessions and runs their capture loops on a fixed
+	 pool of worker threads instead of a thread per camera. A camera is only ever
+	 handled by one worker at a time, and the worker always picks the camera whose
+	 next poll is the most overdue. Add all cameras before calling setup().
+
+	 Live view polls are rationed per USB bus: every camera streaming live view
+	 on a bus gets an equal share of the bus budget, and its previews are spaced
+	 by its measured bytes per frame divided by that share. While any camera on
+	 a bus has a photo to take or download, live view on that bus pauses.
+	 */
+	class CameraRig {
+	public:
+		CameraRig();
+		~CameraRig();
+
+		GPhoto& addCamera(int id);
+		GPhoto& addCamera(string value, MatchBy matchBy = MATCH_PORT);
+		int addAllCameras(); // every camera found in one detection pass
+
+		void setup(int numWorkers = 4);
+		void setBusBudget(float bytesPerSecond); // live view bytes per second per bus, 0 for no limit
+		float getBusBudget() const;
+		void setWorkerThreadSettings(const ThreadSettings& settings); // the workers are the capture threads, call before setup()
+		void update(); // call from ofApp::update()
+		void close();
+		float getShutdownSeconds() const; // how long the last close() took
+
+		size_t size() const;
+		GPhoto& getCamera(size_t i);
+		GPhoto& operator[](size_t i);
+
+		// fire every camera at the same instant, the photos arrive through isPhotoNew() afterwards
+		TriggerResult trigger();
+
+		RigCameraStats getCameraStats(size_t i);
+		RigStats getStats();
+
+		/*
+		 In atlas mode the workers decode every live frame straight into its
+		 camera's tile of one shared pixel buffer, and update() uploads that
+		 buffer in a single pass instead of one texture per camera. With
+		 dctDownscale the jpeg decoder already scales by 1/2, 1/4 or 1/8 while
+		 decoding, which is much cheaper than decoding full size and resizing.
+		 Call it after adding the cameras and before setup().
+		 */
+		void setupAtlas(int tileWidth, int tileHeight, int columns = 0, bool dctDownscale = true);
+		bool isAtlas() const;
+		ofRectangle getTileRect(size_t i); // where camera i's picture is in the atlas
+		const ofTexture& getAtlasTexture() const;
+		void drawAtlas(float x, float y);
+		void drawTile(size_t i, float x, float y, float width, float height);
+
+	protected:
+		typedef CaptureScheduler::Clock Clock;
+
+		struct Session {
+			unique_ptr<GPhoto> camera;
+			bool inFlight;
+			Clock::time_point nextPoll;
+			Clock::time_point nextLiveView;
+			unsigned int liveFrames;
+			bool photoPending;
+			bool liveView;
+			float bytesPerFrame;
+			RigCameraStats stats;
+			ofBuffer liveFrame;
+			ofRectangle tileContent;
+		};
+
+		GPhoto& addSession();
+		void workerLoop();
+		bool isLiveViewAllowed(const Session& session, Clock::time_point now) const;
+		void scheduleLiveView(Session& session, Clock::time_point pollStart, bool gotFrame);
+		float busBudget;
+
+		void decodeIntoTile(size_t i);
+		bool atlas;
+		bool dctDownscale;
+		int tileWidth, tileHeight, columns;
+		ofPixels atlasPixels;
+		ofTexture atlasTexture;
+		bool atlasDirty;
+		std::mutex atlasMutex;
+
+		vector<Session> sessions;
+		vector<thread> workers;
+		ThreadSettings workerThreadSettings;
+		std::mutex sessionMutex;
+		condition_variable sessionDone;
+		bool running;
+		float startTime;
+		float shutdownSeconds;
+	};
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxGphoto {
+	struct SchedulerStats {
+		unsigned int fired; // shots triggered so far
+		unsigned int missed; // deadlines skipped because we were more than half an interval late
+		float lastJitterMs, meanJitterMs, maxJitterMs; // how late the shots were triggered
+	};
+
+	/*
+	 Fires at absolute deadlines start + k * interval on the monotonic clock, so
+	 a late shot never pushes the following ones back and the schedule can't
+	 drift. An interval of 0 fires as fast as the camera allows (burst).
+	 */
+	class CaptureScheduler {
+	public:
+		typedef chrono::steady_clock Clock;
+	protected:
+		Clock::time_point startTime;
+		Clock::duration interval;
+		unsigned int count, index;
+		bool running;
+		SchedulerStats stats;
+		double jitterSum;
+	public:
+		CaptureScheduler() :
+		count(0),
+		index(0),
+		running(false) {
+			resetStats();
+		}
+		void start(float intervalSeconds, unsigned int count = 0, float delaySeconds = 0) {
+			interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(intervalSeconds));
+			startTime = Clock::now() + chrono::duration_cast<Clock::duration>(chrono::duration<double>(delaySeconds));
+			this->count = count;
+			index = 0;
+			running = true;
+			resetStats();
+		}
+		void stop() {
+			running = false;
+		}
+		bool isRunning() const {
+			return running;
+		}
+		void resetStats() {
+			stats = SchedulerStats();
+			jitterSum = 0;
+		}
+		const SchedulerStats& getStats() const {
+			return stats;
+		}
+		Clock::time_point getNextDeadline() const {
+			return startTime + interval * index;
+		}
+		// true once the current deadline is reached, skipping deadlines that are already lost
+		bool isDue(Clock::time_point now) {
+			if(!running) {
+				return false;
+			}
+			if(interval != Clock::duration::zero()) {
+				while(now - getNextDeadline() > interval / 2) {
+					stats.missed++;
+					advance();
+					if(!running) {
+						return false;
+					}
+				}
+			}
+			return now >= getNextDeadline();
+		}
+		// call once the shot for the current deadline went off, with the time the trigger started
+		void fired(Clock::time_point when) {
+			float jitterMs = interval == Clock::duration::zero() ? 0 :
+				chrono::duration<float, milli>(when - getNextDeadline()).count();
+			stats.fired++;
+			stats.lastJitterMs = jitterMs;
+			stats.maxJitterMs = max(stats.maxJitterMs, jitterMs);
+			jitterSum += jitterMs;
+			stats.meanJitterMs = jitterSum / stats.fired;
+			advance();
+		}
+	protected:
+		void advance() {
+			index++;
+			if(count > 0 && index >= count) {
+				running = false;
+			}
+		}
+	};
+}
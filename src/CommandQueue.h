@@ -0,0 +1,94 @@
+#pragma once
+
+#include <future>
+#include "ofMain.h"
+
+namespace ofxGphoto {
+
+	/*
+	 Kinds of camera work, in the order the capture thread runs them. Settings
+	 come first so a shot requested right after a change is taken with it,
+	 and everything goes before the live view.
+	 */
+	enum CommandType {
+		COMMAND_CONFIG_SET,
+		COMMAND_CAPTURE,
+		COMMAND_CONFIG_GET,
+		COMMAND_FILE,
+		COMMAND_LIVE_VIEW,
+		COMMAND_TYPE_COUNT
+	};
+
+	/*
+	 Camera calls handed to the capture thread, so libgphoto2 never sees two
+	 threads on the same Camera. Commands of one type run in the order they
+	 were pushed, and each one fulfils a future with its gphoto result.
+	 */
+	class CommandQueue {
+	public:
+		typedef function<int()> Command;
+
+		future<int> push(CommandType type, Command command) {
+			Entry entry;
+			entry.command = move(command);
+			future<int> result = entry.result.get_future();
+			lock_guard<std::mutex> guard(mutex);
+			queues[type].push_back(move(entry));
+			return result;
+		}
+		// runs the most urgent command that is at least as urgent as lowest
+		bool runNext(CommandType lowest = COMMAND_LIVE_VIEW) {
+			Entry entry;
+			{
+				lock_guard<std::mutex> guard(mutex);
+				int type = 0;
+				while(type <= lowest && queues[type].empty()) {
+					type++;
+				}
+				if(type > lowest) {
+					return false;
+				}
+				entry = move(queues[type].front());
+				queues[type].pop_front();
+			}
+			entry.result.set_value(entry.command());
+			return true;
+		}
+		bool hasPending(CommandType lowest = COMMAND_LIVE_VIEW) const {
+			lock_guard<std::mutex> guard(mutex);
+			for(int type = 0; type <= lowest; type++) {
+				if(!queues[type].empty()) {
+					return true;
+				}
+			}
+			return false;
+		}
+		size_t size(CommandType type) const {
+			lock_guard<std::mutex> guard(mutex);
+			return queues[type].size();
+		}
+		// give up on everything still waiting, e.g. when the camera is closed
+		void cancelAll(int result) {
+			deque<Entry> cancelled[COMMAND_TYPE_COUNT];
+			{
+				lock_guard<std::mutex> guard(mutex);
+				for(int type = 0; type < COMMAND_TYPE_COUNT; type++) {
+					cancelled[type].swap(queues[type]);
+				}
+			}
+			for(auto& queue:cancelled) {
+				for(auto& entry:queue) {
+					entry.result.set_value(result);
+				}
+			}
+		}
+
+	protected:
+		struct Entry {
+			Command command;
+			promise<int> result;
+		};
+		mutable std::mutex mutex;
+		deque<Entry> queues[COMMAND_TYPE_COUNT];
+	};
+}
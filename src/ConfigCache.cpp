@@ -0,0 +1,381 @@
+#include "ConfigCache.h"
+
+namespace ofxGphoto {
+
+	ConfigCache::ConfigCache() :
+	root(nullptr),
+	allStale(true) {
+	}
+
+	ConfigCache::~ConfigCache() {
+		clear();
+	}
+
+	void ConfigCache::clear() {
+		if(root) {
+			gp_widget_free(root);
+			root = nullptr;
+		}
+		byName.clear();
+		byLabel.clear();
+		choiceTables.clear();
+		staleKeys.clear();
+		allStale = true;
+	}
+
+	bool ConfigCache::needsRefresh() const {
+		return allStale || !staleKeys.empty();
+	}
+
+	void ConfigCache::markStale(const string& key) {
+		staleKeys.insert(key);
+	}
+
+	void ConfigCache::markAllStale() {
+		allStale = true;
+	}
+
+	bool ConfigCache::hasTree() const {
+		return root != nullptr;
+	}
+
+	bool ConfigCache::takeStale(set<string>& names) {
+		bool all = allStale || !root;
+		for(auto& key:staleKeys) {
+			CameraWidget *widget = find(key);
+			const char *name = nullptr;
+			if(!widget || gp_widget_get_name(widget, &name) < GP_OK || !name) {
+				// we can't tell which widget this is without the whole tree
+				all = true;
+				break;
+			}
+			names.insert(name);
+		}
+		staleKeys.clear();
+		allStale = false;
+		if(all) {
+			names.clear();
+		}
+		return all;
+	}
+
+	void ConfigCache::adopt(ConfigCache& fresh) {
+		std::swap(root, fresh.root);
+		byName.swap(fresh.byName);
+		byLabel.swap(fresh.byLabel);
+		choiceTables.swap(fresh.choiceTables);
+	}
+
+	int ConfigCache::load(Camera *camera, GPContext *context) {
+		CameraWidget *widget = nullptr;
+		int ret = gp_camera_get_config(camera, &widget, context);
+		if(ret < GP_OK) {
+			ofLogError("ofxGphoto::ConfigCache") << "camera_get_config failed: " << gp_result_as_string(ret);
+			return ret;
+		}
+		clear();
+		root = widget;
+		index(root);
+		allStale = false;
+		return GP_OK;
+	}
+
+	/*
+	 Copies the current value of one widget into the cached tree, so pointers
+	 into the tree that were handed out stay valid. fresh stays with the caller.
+	 */
+	int ConfigCache::updateKey(const string& name, CameraWidget *fresh) {
+		CameraWidget *cached = find(name);
+		if(!cached) {
+			return GP_ERROR_BAD_PARAMETERS;
+		}
+		int ret = GP_OK;
+		CameraWidgetType type;
+		gp_widget_get_type(fresh, &type);
+		switch(type) {
+			case GP_WIDGET_TEXT:
+			case GP_WIDGET_RADIO:
+			case GP_WIDGET_MENU: {
+				char *value = nullptr;
+				ret = gp_widget_get_value(fresh, &value);
+				if(ret >= GP_OK) {
+					ret = gp_widget_set_value(cached, value);
+				}
+				break;
+			}
+			case GP_WIDGET_RANGE: {
+				float value;
+				ret = gp_widget_get_value(fresh, &value);
+				if(ret >= GP_OK) {
+					ret = gp_widget_set_value(cached, &value);
+				}
+				break;
+			}
+			case GP_WIDGET_TOGGLE:
+			case GP_WIDGET_DATE: {
+				int value;
+				ret = gp_widget_get_value(fresh, &value);
+				if(ret >= GP_OK) {
+					ret = gp_widget_set_value(cached, &value);
+				}
+				break;
+			}
+			default:
+				break;
+		}
+		// this is the camera's value, not a change we want to write back
+		gp_widget_set_changed(cached, 0);
+		return ret;
+	}
+
+	void ConfigCache::index(CameraWidget *widget) {
+		const char *name = nullptr, *label = nullptr;
+		gp_widget_get_name(widget, &name);
+		gp_widget_get_label(widget, &label);
+		if(name && *name) {
+			byName[name] = widget;
+		}
+		if(label && *label) {
+			byLabel[label] = widget;
+		}
+		CameraWidgetType type;
+		gp_widget_get_type(widget, &type);
+		if(type == GP_WIDGET_RADIO || type == GP_WIDGET_MENU) {
+			ChoiceTable& table = choiceTables[widget];
+			int choices = gp_widget_count_choices(widget);
+			table.choices.reserve(max(choices, 0));
+			for(int i = 0; i < choices; i++) {
+				const char *choice = nullptr;
+				if(gp_widget_get_choice(widget, i, &choice) >= GP_OK && choice) {
+					table.indices.insert(make_pair(string(choice), (int) table.choices.size()));
+					table.choices.push_back(choice);
+				}
+			}
+		}
+		int children = gp_widget_count_children(widget);
+		for(int i = 0; i < children; i++) {
+			CameraWidget *child = nullptr;
+			if(gp_widget_get_child(widget, i, &child) >= GP_OK) {
+				index(child);
+			}
+		}
+	}
+
+	CameraWidget* ConfigCache::find(const string& key) const {
+		auto it = byName.find(key);
+		if(it != byName.end()) {
+			return it->second;
+		}
+		it = byLabel.find(key);
+		if(it != byLabel.end()) {
+			return it->second;
+		}
+		return nullptr;
+	}
+
+	bool ConfigCache::getString(const string& key, string& value) const {
+		CameraWidget *widget = find(key);
+		if(!widget) {
+			return false;
+		}
+		CameraWidgetType type;
+		gp_widget_get_type(widget, &type);
+		switch(type) {
+			case GP_WIDGET_TEXT:
+			case GP_WIDGET_RADIO:
+			case GP_WIDGET_MENU: {
+				char *str = nullptr;
+				if(gp_widget_get_value(widget, &str) < GP_OK || !str) {
+					return false;
+				}
+				value = str;
+				return true;
+			}
+			case GP_WIDGET_RANGE: {
+				float f;
+				if(gp_widget_get_value(widget, &f) < GP_OK) {
+					return false;
+				}
+				value = ofToString(f);
+				return true;
+			}
+			case GP_WIDGET_TOGGLE:
+			case GP_WIDGET_DATE: {
+				int i;
+				if(gp_widget_get_value(widget, &i) < GP_OK) {
+					return false;
+				}
+				value = ofToString(i);
+				return true;
+			}
+			default:
+				return false;
+		}
+	}
+
+	/*
+	 Writes a value into the cached widget and marks it changed, so the next
+	 gp_camera_set_config on the root sends it to the camera. Menu and radio
+	 values have to be one of the widget's choices. The widget is marked even
+	 if the value is the same, action widgets like manualfocusdrive have to be
+	 sent again for every step.
+	 */
+	void ConfigCache::clearChanged(const string& key) {
+		CameraWidget *widget = find(key);
+		if(widget) {
+			// reading the flag resets it
+			gp_widget_changed(widget);
+		}
+	}
+
+	int ConfigCache::setString(const string& key, const string& value) {
+		CameraWidget *widget = find(key);
+		if(!widget) {
+			return GP_ERROR_BAD_PARAMETERS;
+		}
+		int readonly = 0;
+		gp_widget_get_readonly(widget, &readonly);
+		if(readonly) {
+			return GP_ERROR_NOT_SUPPORTED;
+		}
+		CameraWidgetType type;
+		gp_widget_get_type(widget, &type);
+		int retval;
+		switch(type) {
+			case GP_WIDGET_RADIO:
+			case GP_WIDGET_MENU: {
+				auto table = choiceTables.find(widget);
+				if(table == choiceTables.end() || table->second.indexOf(value) < 0) {
+					return GP_ERROR_BAD_PARAMETERS;
+				}
+				retval = gp_widget_set_value(widget, value.c_str());
+				break;
+			}
+			case GP_WIDGET_TEXT:
+				retval = gp_widget_set_value(widget, value.c_str());
+				break;
+			case GP_WIDGET_RANGE: {
+				float f = ofToFloat(value);
+				retval = gp_widget_set_value(widget, &f);
+				break;
+			}
+			case GP_WIDGET_TOGGLE:
+			case GP_WIDGET_DATE: {
+				int i = ofToInt(value);
+				retval = gp_widget_set_value(widget, &i);
+				break;
+			}
+			default:
+				return GP_ERROR_NOT_SUPPORTED;
+		}
+		if(retval >= GP_OK) {
+			gp_widget_set_changed(widget, 1);
+		}
+		return retval;
+	}
+
+	bool ConfigCache::getNumber(const string& key, float& value) const {
+		CameraWidget *widget = find(key);
+		if(!widget) {
+			return false;
+		}
+		CameraWidgetType type;
+		gp_widget_get_type(widget, &type);
+		if(type == GP_WIDGET_RANGE) {
+			return gp_widget_get_value(widget, &value) >= GP_OK;
+		}
+		if(type == GP_WIDGET_TOGGLE || type == GP_WIDGET_DATE) {
+			int i;
+			if(gp_widget_get_value(widget, &i) < GP_OK) {
+				return false;
+			}
+			value = i;
+			return true;
+		}
+		return false;
+	}
+
+	bool ConfigCache::getInt(const string& key, int& value) const {
+		float f;
+		if(!getNumber(key, f)) {
+			return false;
+		}
+		value = (int) roundf(f);
+		return true;
+	}
+
+	bool ConfigCache::getFloat(const string& key, float& value) const {
+		return getNumber(key, value);
+	}
+
+	bool ConfigCache::getToggle(const string& key, bool& value) const {
+		CameraWidget *widget = find(key);
+		CameraWidgetType type;
+		if(!widget || gp_widget_get_type(widget, &type) < GP_OK || type != GP_WIDGET_TOGGLE) {
+			return false;
+		}
+		int i;
+		if(gp_widget_get_value(widget, &i) < GP_OK) {
+			return false;
+		}
+		value = i != 0;
+		return true;
+	}
+
+	bool ConfigCache::getRange(const string& key, float& min, float& max, float& increment) const {
+		CameraWidget *widget = find(key);
+		CameraWidgetType type;
+		if(!widget || gp_widget_get_type(widget, &type) < GP_OK || type != GP_WIDGET_RANGE) {
+			return false;
+		}
+		return gp_widget_get_range(widget, &min, &max, &increment) >= GP_OK;
+	}
+
+	const ChoiceTable* ConfigCache::getChoices(const string& key) const {
+		CameraWidget *widget = find(key);
+		if(!widget) {
+			return nullptr;
+		}
+		auto table = choiceTables.find(widget);
+		return table == choiceTables.end() ? nullptr : &table->second;
+	}
+
+	int ConfigCache::getChoiceIndex(const string& key) const {
+		const ChoiceTable *table = getChoices(key);
+		string value;
+		if(!table || !getString(key, value)) {
+			return -1;
+		}
+		return table->indexOf(value);
+	}
+
+	bool ConfigCache::isWritable(const string& key) const {
+		CameraWidget *widget = find(key);
+		if(!widget) {
+			return false;
+		}
+		int readonly = 0;
+		gp_widget_get_readonly(widget, &readonly);
+		CameraWidgetType type;
+		gp_widget_get_type(widget, &type);
+		return !readonly && type != GP_WIDGET_DATE && type != GP_WIDGET_BUTTON &&
+			type != GP_WIDGET_WINDOW && type != GP_WIDGET_SECTION;
+	}
+
+	vector<string> ConfigCache::getKeys() const {
+		vector<string> keys;
+		for(auto& w:byName) {
+			CameraWidgetType type;
+			gp_widget_get_type(w.second, &type);
+			if(type != GP_WIDGET_WINDOW && type != GP_WIDGET_SECTION && type != GP_WIDGET_BUTTON) {
+				keys.push_back(w.first);
+			}
+		}
+		sort(keys.begin(), keys.end());
+		return keys;
+	}
+
+	CameraWidget* ConfigCache::getRoot() {
+		return root;
+	}
+}
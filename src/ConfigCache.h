@@ -0,0 +1,80 @@
+#pragma once
+
+#include <gphoto2/gphoto2.h>
+#include "ofMain.h"
+
+namespace ofxGphoto {
+
+	/*
+	 ConfigCache keeps the camera's whole widget tree from a single
+	 gp_camera_get_config call and indexes every widget by name and by label,
+	 so reading a setting is a hash map lookup instead of a camera round-trip.
+	 Keys can be marked stale one by one (refreshed with
+	 gp_camera_get_single_config) or all at once (the tree is fetched again).
+	 The cache does no locking of its own and must only be refreshed by the
+	 thread that owns the camera.
+
+	 Refreshing is split up so the camera round trips can run without the
+	 caller's lock: takeStale() hands over what has to be read, the widgets
+	 are fetched unlocked, and updateKey() or adopt() bring them in under the
+	 lock again. Keys marked stale in the meantime stay stale.
+	 */
+
+	/*
+	 The choices of a radio or menu widget, read once when the tree is indexed,
+	 so stepping through ISO or shutter speeds maps between index and value
+	 without string compares against the widget.
+	 */
+	struct ChoiceTable {
+		vector<string> choices;
+		unordered_map<string, int> indices;
+		int indexOf(const string& value) const {
+			auto it = indices.find(value);
+			return it == indices.end() ? -1 : it->second;
+		}
+	};
+
+	class ConfigCache {
+	public:
+		ConfigCache();
+		~ConfigCache();
+
+		bool needsRefresh() const;
+		void markStale(const string& key);
+		void markAllStale();
+		void clear();
+
+		bool takeStale(set<string>& names); // true if the whole tree is needed, otherwise the widget names to re-read
+		int load(Camera *camera, GPContext *context); // fetch and index the whole tree, into a cache of its own
+		void adopt(ConfigCache& fresh); // take over a loaded tree
+		int updateKey(const string& name, CameraWidget *fresh); // copy a freshly read widget's value
+		bool hasTree() const;
+
+		CameraWidget* find(const string& key) const;
+		bool getString(const string& key, string& value) const;
+		int setString(const string& key, const string& value); // stage a change in the cached tree
+		void clearChanged(const string& key); // unstage, the value stays
+
+		// typed reads, false if the widget doesn't exist or has another type
+		bool getInt(const string& key, int& value) const; // toggle, date or range
+		bool getFloat(const string& key, float& value) const; // range, toggle or date
+		bool getToggle(const string& key, bool& value) const;
+		bool getRange(const string& key, float& min, float& max, float& increment) const;
+		const ChoiceTable* getChoices(const string& key) const; // nullptr unless radio or menu
+		int getChoiceIndex(const string& key) const; // -1 if unknown
+		vector<string> getKeys() const; // names of all value widgets
+		bool isWritable(const string& key) const; // a setting, not a read-only value or a clock
+		CameraWidget* getRoot();
+
+	protected:
+		void index(CameraWidget *widget);
+		bool getNumber(const string& key, float& value) const;
+
+		CameraWidget *root;
+		unordered_map<string, CameraWidget*> byName;
+		unordered_map<string, CameraWidget*> byLabel;
+		unordered_map<CameraWidget*, ChoiceTable> choiceTables;
+		set<string> staleKeys;
+		bool allStale;
+	};
+}
@@ -0,0 +1,90 @@
+#include "ConfigPreset.h"
+
+namespace ofxGphoto {
+
+	bool ConfigPreset::load(const string& filename) {
+		ofFile file(filename);
+		if(!file.exists()) {
+			ofLogError("ofxGphoto::ConfigPreset") << "No preset " << filename;
+			return false;
+		}
+		ofBuffer buffer = ofBufferFromFile(filename, false);
+		values.clear();
+		for(auto& line:buffer.getLines()) {
+			string trimmed = ofTrim(line);
+			if(trimmed.empty() || trimmed[0] == '#') {
+				continue;
+			}
+			// values may contain '=' themselves, keys never do
+			size_t split = trimmed.find('=');
+			if(split == string::npos) {
+				ofLogWarning("ofxGphoto::ConfigPreset") << "Ignoring line without '=': " << trimmed;
+				continue;
+			}
+			values[ofTrim(trimmed.substr(0, split))] = ofTrim(trimmed.substr(split + 1));
+		}
+		return true;
+	}
+
+	bool ConfigPreset::save(const string& filename) const {
+		string text;
+		for(auto& value:values) {
+			text += value.first + "=" + value.second + "\n";
+		}
+		ofBuffer buffer;
+		buffer.set(text.c_str(), text.size());
+		return ofBufferToFile(filename, buffer, false);
+	}
+
+	void ConfigPreset::set(const string& key, const string& value) {
+		values[key] = value;
+	}
+
+	bool ConfigPreset::get(const string& key, string& value) const {
+		auto it = values.find(key);
+		if(it == values.end()) {
+			return false;
+		}
+		value = it->second;
+		return true;
+	}
+
+	void ConfigPreset::remove(const string& key) {
+		values.erase(key);
+	}
+
+	const map<string, string>& ConfigPreset::getValues() const {
+		return values;
+	}
+
+	bool ConfigPreset::empty() const {
+		return values.empty();
+	}
+
+	/*
+	 Numbers are compared as numbers, because a range value that went through
+	 a file may be printed differently than the cache prints it. Keys the
+	 camera doesn't know are left out, presets can be shared between models.
+	 */
+	ConfigTransaction ConfigPreset::diff(const ConfigCache& cache) const {
+		ConfigTransaction transaction;
+		for(auto& value:values) {
+			float number;
+			if(cache.getFloat(value.first, number)) {
+				if(fabsf(number - ofToFloat(value.second)) > 1e-4f) {
+					transaction.set(value.first, value.second);
+				}
+				continue;
+			}
+			string current;
+			if(!cache.getString(value.first, current)) {
+				ofLogVerbose("ofxGphoto::ConfigPreset") << "Camera has no " << value.first;
+				continue;
+			}
+			if(current != value.second) {
+				transaction.set(value.first, value.second);
+			}
+		}
+		return transaction;
+	}
+}
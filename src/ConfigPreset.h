@@ -0,0 +1,32 @@
+#pragma once
+
+#include <gphoto2/gphoto2.h>
+#include "ofMain.h"
+#include "ConfigCache.h"
+#include "ConfigTransaction.h"
+
+namespace ofxGphoto {
+
+	/*
+	 A named set of camera settings that can be saved to and loaded from a
+	 plain text file, one "key=value" per line. diff() compares the preset
+	 with the cached camera config and returns only the settings that differ,
+	 so switching presets is a single small transaction.
+	 */
+	class ConfigPreset {
+	public:
+		bool load(const string& filename);
+		bool save(const string& filename) const;
+
+		void set(const string& key, const string& value);
+		bool get(const string& key, string& value) const;
+		void remove(const string& key);
+		const map<string, string>& getValues() const;
+		bool empty() const;
+
+		ConfigTransaction diff(const ConfigCache& cache) const;
+
+	protected:
+		map<string, string> values;
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <gphoto2/gphoto2.h>
+#include "ofMain.h"
+
+namespace ofxGphoto {
+
+	struct ConfigResult {
+		vector<pair<string, int> > results; // gphoto result per key, in the order they were staged
+		int result; // what gp_camera_set_config returned
+		float latencyMs; // from applyConfig() until the camera accepted the settings
+		bool success() const {
+			if(result < GP_OK) {
+				return false;
+			}
+			for(auto& r:results) {
+				if(r.second < GP_OK) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	/*
+	 A set of settings that GPhoto::applyConfig() writes to the camera in a
+	 single gp_camera_set_config call. Values are given as strings and
+	 converted to the widget's type when they are applied, so "400" works for
+	 a menu as well as for a range widget.
+	 */
+	class ConfigTransaction {
+	protected:
+		vector<pair<string, string> > changes;
+	public:
+		ConfigTransaction& set(const string& key, const string& value) {
+			for(auto& c:changes) {
+				if(c.first == key) {
+					c.second = value;
+					return *this;
+				}
+			}
+			changes.push_back(make_pair(key, value));
+			return *this;
+		}
+		ConfigTransaction& set(const string& key, const char *value) {
+			return set(key, string(value));
+		}
+		ConfigTransaction& set(const string& key, float value) {
+			stringstream str;
+			str.precision(9);
+			str << value;
+			return set(key, str.str());
+		}
+		// a plain literal like 0.3 is a double, and would be ambiguous between float, int and bool
+		ConfigTransaction& set(const string& key, double value) {
+			stringstream str;
+			str.precision(9);
+			str << value;
+			return set(key, str.str());
+		}
+		ConfigTransaction& set(const string& key, int value) {
+			return set(key, ofToString(value));
+		}
+		ConfigTransaction& set(const string& key, bool value) {
+			return set(key, string(value ? "1" : "0"));
+		}
+		bool get(const string& key, string& value) const {
+			for(auto& c:changes) {
+				if(c.first == key) {
+					value = c.second;
+					return true;
+				}
+			}
+			return false;
+		}
+		const vector<pair<string, string> >& getChanges() const {
+			return changes;
+		}
+		bool empty() const {
+			return changes.empty();
+		}
+		void clear() {
+			changes.clear();
+		}
+	};
+}
@@ -0,0 +1,178 @@
+#include "DeviceWatcher.h"
+
+namespace ofxGphoto {
+
+	DeviceWatcher::DeviceWatcher() :
+	pollInterval(1),
+	initialBackoff(1),
+	maxBackoff(60),
+	context(nullptr) {
+	}
+
+	DeviceWatcher::~DeviceWatcher() {
+		close();
+	}
+
+	void DeviceWatcher::setup(float pollIntervalSeconds) {
+		pollInterval = pollIntervalSeconds;
+		if(!context) {
+			context = gp_context_new();
+		}
+		startThread();
+	}
+
+	void DeviceWatcher::close() {
+		if(isThreadRunning()) {
+			waitForThread(true);
+		}
+		if(context) {
+			gp_context_unref(context);
+			context = nullptr;
+		}
+	}
+
+	void DeviceWatcher::watch(GPhoto& camera) {
+		lock();
+		WatchedCamera w;
+		w.camera = &camera;
+		w.wasConnected = camera.isConnected();
+		w.attemptPending = false;
+		w.backoff = initialBackoff;
+		w.nextAttemptTime = 0;
+		watched.push_back(w);
+		unlock();
+	}
+
+	void DeviceWatcher::unwatch(GPhoto& camera) {
+		lock();
+		watched.erase(remove_if(watched.begin(), watched.end(), [&](const WatchedCamera& w) {
+			return w.camera == &camera;
+		}), watched.end());
+		unlock();
+	}
+
+	void DeviceWatcher::setBackoff(float initialSeconds, float maxSeconds) {
+		lock();
+		initialBackoff = initialSeconds;
+		maxBackoff = maxSeconds;
+		unlock();
+	}
+
+	vector<CameraInformation> DeviceWatcher::getDevices() {
+		vector<CameraInformation> info;
+		lock();
+		for(auto& d:devices) {
+			info.push_back(CameraInformation());
+			info.back().id = info.size() - 1;
+			info.back().name = d.second;
+			info.back().port = d.first;
+		}
+		unlock();
+		return info;
+	}
+
+	void DeviceWatcher::threadedFunction() {
+		while(isThreadRunning()) {
+			pollDevices();
+			float wakeTime = ofGetElapsedTimef() + pollInterval;
+			while(isThreadRunning() && ofGetElapsedTimef() < wakeTime) {
+				ofSleepMillis(10);
+			}
+		}
+	}
+
+	/*
+	 Diffs the autodetect list against the previous poll. Ports are the key, a
+	 camera that is unplugged and plugged back in shows up as a disconnect
+	 followed by a connect on a new port.
+	 */
+	void DeviceWatcher::pollDevices() {
+		CameraList *list;
+		gp_list_new(&list);
+		int count = autodetectCameras(list, context);
+		if(count < GP_OK) {
+			ofLogError("ofxGphoto::DeviceWatcher") << "autodetect failed: " << gp_result_as_string(count);
+			gp_list_free(list);
+			return;
+		}
+
+		map<string, string> current;
+		for(int i = 0; i < count; i++) {
+			const char *name, *port;
+			gp_list_get_name(list, i, &name);
+			gp_list_get_value(list, i, &port);
+			current[port] = name;
+		}
+		gp_list_free(list);
+
+		lock();
+		map<string, string> previous = devices;
+		devices = current;
+		unlock();
+
+		bool devicesAdded = false;
+		for(auto& d:previous) {
+			if(current.find(d.first) == current.end()) {
+				CameraInformation info = CameraInformation();
+				info.id = -1;
+				info.name = d.second;
+				info.port = d.first;
+				ofLogNotice("ofxGphoto::DeviceWatcher") << "disconnected " << info.name << " on " << info.port;
+				ofNotifyEvent(deviceDisconnected, info);
+			}
+		}
+		for(auto& d:current) {
+			if(previous.find(d.first) == previous.end()) {
+				CameraInformation info = CameraInformation();
+				info.id = -1;
+				info.name = d.second;
+				info.port = d.first;
+				devicesAdded = true;
+				ofLogNotice("ofxGphoto::DeviceWatcher") << "connected " << info.name << " on " << info.port;
+				ofNotifyEvent(deviceConnected, info);
+			}
+		}
+
+		reconnectCameras(devicesAdded);
+	}
+
+	/*
+	 A disconnected GPhoto is retried when a new device shows up, or when its
+	 backoff runs out (the camera may have woken up on the same port). Every
+	 failed attempt doubles the backoff up to maxBackoff.
+	 */
+	void DeviceWatcher::reconnectCameras(bool devicesAdded) {
+		vector<CameraInformation> reconnected;
+		float now = ofGetElapsedTimef();
+
+		lock();
+		for(auto& w:watched) {
+			bool connected = w.camera->isConnected();
+			if(w.attemptPending) {
+				if(w.camera->isReconnecting()) {
+					continue;
+				}
+				w.attemptPending = false;
+				if(connected) {
+					w.backoff = initialBackoff;
+					reconnected.push_back(w.camera->getCameraInformation());
+				} else {
+					w.nextAttemptTime = now + w.backoff;
+					w.backoff = min(w.backoff * 2, maxBackoff);
+				}
+			} else if(!connected && (devicesAdded || now >= w.nextAttemptTime)) {
+				w.camera->requestReconnect();
+				w.attemptPending = true;
+			} else if(connected && !w.wasConnected) {
+				w.backoff = initialBackoff;
+			}
+			w.wasConnected = connected;
+		}
+		unlock();
+
+		for(auto& info:reconnected) {
+			ofLogNotice("ofxGphoto::DeviceWatcher") << "reconnected " << info.name << " on " << info.port;
+			ofNotifyEvent(cameraReconnected, info);
+		}
+	}
+}
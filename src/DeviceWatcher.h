@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ofxGphoto.h"
+
+namespace ofxGphoto {
+
+	/*
+	 DeviceWatcher polls the camera list on its own thread and reports cameras
+	 coming and going. GPhoto instances added with watch() are reconnected to
+	 their bound camera (by serial number, or by port if the serial is unknown)
+	 once it shows up again, retrying with exponential backoff in between.
+	 The events are notified on the watcher thread.
+	 */
+	class DeviceWatcher : public ofThread {
+	public:
+		DeviceWatcher();
+		~DeviceWatcher();
+
+		void setup(float pollIntervalSeconds = 1);
+		void close();
+
+		void watch(GPhoto& camera);
+		void unwatch(GPhoto& camera);
+		void setBackoff(float initialSeconds, float maxSeconds);
+
+		vector<CameraInformation> getDevices();
+
+		ofEvent<CameraInformation> deviceConnected;
+		ofEvent<CameraInformation> deviceDisconnected;
+		ofEvent<CameraInformation> cameraReconnected; // a watched GPhoto is back
+
+	private:
+		void threadedFunction();
+		void pollDevices();
+		void reconnectCameras(bool devicesAdded);
+
+		struct WatchedCamera {
+			GPhoto *camera;
+			bool wasConnected;
+			bool attemptPending; // a reconnect has been requested and not finished yet
+			float backoff;
+			float nextAttemptTime;
+		};
+
+		float pollInterval;
+		float initialBackoff, maxBackoff;
+		GPContext *context;
+		map<string, string> devices; // port -> model from the last poll
+		vector<WatchedCamera> watched;
+	};
+}
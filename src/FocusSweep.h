@@ -0,0 +1,142 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxGphoto {
+	struct FocusSweepSettings {
+		int maxSteps; // give up after this many drive steps
+		int settleFrames; // live frames to skip after a step, while the preview catches up
+		float tolerance; // relative sharpness change that counts as better or worse
+		ofRectangle roi; // normalized region that is scored
+		FocusSweepSettings() :
+		maxSteps(60),
+		settleFrames(1),
+		tolerance(.02f),
+		roi(.25f, .25f, .5f, .5f) {
+		}
+	};
+
+	struct FocusSweepResult {
+		bool running;
+		bool converged; // false if it was cancelled, failed or ran out of steps
+		int steps;
+		float bestSharpness;
+		float finalSharpness;
+		float seconds;
+		vector<float> scores; // every scored position, in order
+	};
+
+	/*
+	 Hill climbing over relative focus drive steps. Steps are -3..3, larger
+	 numbers move further and the sign is the direction (positive is far).
+	 The sweep starts with the coarsest step and each time the score drops
+	 past the peak it turns around with the next finer step. Once fine steps
+	 have passed the peak it walks back to the best one and is done. If the
+	 coarse steps see nothing for a while, the peak is probably the other
+	 way. Only the decisions live here, driving the lens and scoring frames is
+	 up to the caller.
+	 */
+	class FocusSweep {
+	protected:
+		FocusSweepSettings settings;
+		FocusSweepResult result;
+		int direction, level;
+		float best;
+		int stepsSinceBest; // how far we are past the best score, in steps of the current level
+		int stepsBack; // left to take back to the best position once done
+		bool turnedInBlur;
+		float startTime;
+		void finish(bool converged) {
+			result.running = false;
+			result.converged = converged;
+			result.seconds = ofGetElapsedTimef() - startTime;
+		}
+	public:
+		FocusSweep() {
+			result = FocusSweepResult();
+		}
+		void start(const FocusSweepSettings& settings) {
+			this->settings = settings;
+			result = FocusSweepResult();
+			result.running = true;
+			result.bestSharpness = result.finalSharpness = -1;
+			direction = 1;
+			level = 3;
+			best = -1;
+			stepsSinceBest = 0;
+			stepsBack = -1;
+			turnedInBlur = false;
+			startTime = ofGetElapsedTimef();
+		}
+		void cancel() {
+			if(result.running) {
+				finish(false);
+			}
+		}
+		bool isRunning() const {
+			return result.running;
+		}
+		const FocusSweepSettings& getSettings() const {
+			return settings;
+		}
+		const FocusSweepResult& getResult() const {
+			return result;
+		}
+		// the step that follows if the next score doesn't change anything
+		int getExpectedStep() const {
+			if(!result.running) {
+				return 0;
+			}
+			if(stepsBack >= 0) {
+				return stepsBack > 0 ? -direction : 0;
+			}
+			return direction * level;
+		}
+		// the lens hit the end of its range, try the other way
+		void hitLimit() {
+			direction = -direction;
+		}
+		// score of the position the last step led to, returns the next step or 0 when done
+		int addScore(float sharpness) {
+			if(!result.running) {
+				return 0;
+			}
+			result.scores.push_back(sharpness);
+			result.finalSharpness = sharpness;
+			result.bestSharpness = max(result.bestSharpness, sharpness);
+			if(stepsBack == 0) {
+				finish(true);
+				return 0;
+			}
+			if(++result.steps > settings.maxSteps) {
+				finish(false);
+				return 0;
+			}
+			if(stepsBack > 0) {
+				stepsBack--;
+				return -direction;
+			}
+			if(best < 0 || sharpness > best * (1 + settings.tolerance)) {
+				best = sharpness;
+				stepsSinceBest = 0;
+			} else if(sharpness < best * (1 - settings.tolerance)) {
+				// past the peak, which is now behind us
+				if(level == 1) {
+					stepsBack = stepsSinceBest;
+					return -direction;
+				}
+				direction = -direction;
+				level--;
+				best = sharpness;
+				stepsSinceBest = 0;
+				return direction * level;
+			} else if(++stepsSinceBest >= 8 && level == 3 && !turnedInBlur) {
+				// nothing but blur this way, once
+				direction = -direction;
+				stepsSinceBest = 0;
+				turnedInBlur = true;
+			}
+			return direction * level;
+		}
+	};
+}
@@ -1,12 +1,126 @@
 #include "GphotoHelperFunctions.h"
+#include <mutex>
+#include <map>
+#include <chrono>
+#include <cstring>
 
 namespace ofxGphoto{
+
+static std::once_flag			abilitiesLoaded;
+static CameraAbilitiesList		*sharedAbilities = NULL;
+static std::mutex			portInfoMutex;
+static std::shared_ptr<GPPortInfoList>	sharedPortInfo;
+static std::mutex			serialPortMutex;
+static std::map<std::string, std::string>	serialPorts;
+
+static std::shared_ptr<GPPortInfoList> loadPortInfoList() {
+	GPPortInfoList *list = NULL;
+	int ret = gp_port_info_list_new (&list);
+	if (ret < GP_OK) return nullptr;
+	std::shared_ptr<GPPortInfoList> shared (list, gp_port_info_list_free);
+	ret = gp_port_info_list_load (list);
+	if (ret < GP_OK) {
+		ofLogError("ofxGphoto") << "loading port drivers failed: " << ret;
+		return nullptr;
+	}
+	return shared;
+}
+
+CameraAbilitiesList* getSharedAbilitiesList() {
+	std::call_once (abilitiesLoaded, [] {
+		auto start = std::chrono::steady_clock::now();
+		CameraAbilitiesList *list = NULL;
+		int ret = gp_abilities_list_new (&list);
+		if (ret >= GP_OK) ret = gp_abilities_list_load (list, NULL);
+		if (ret < GP_OK) {
+			ofLogError("ofxGphoto") << "loading camera drivers failed: " << ret;
+			if (list) gp_abilities_list_free (list);
+			return;
+		}
+		sharedAbilities = list;
+		ofLogNotice("ofxGphoto") << "loaded " << gp_abilities_list_count (list) << " camera models in "
+			<< std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+	});
+	return sharedAbilities;
+}
+
+std::shared_ptr<GPPortInfoList> getSharedPortInfoList() {
+	std::lock_guard<std::mutex> lock (portInfoMutex);
+	if (!sharedPortInfo) {
+		sharedPortInfo = loadPortInfoList();
+	}
+	return sharedPortInfo;
+}
+
+void rememberSerialPort (const std::string& serial, const std::string& port) {
+	if (serial.empty() || port.empty()) return;
+	std::lock_guard<std::mutex> lock (serialPortMutex);
+	serialPorts[serial] = port;
+}
+
+std::string getRememberedPort (const std::string& serial) {
+	std::lock_guard<std::mutex> lock (serialPortMutex);
+	auto it = serialPorts.find (serial);
+	return it == serialPorts.end() ? std::string() : it->second;
+}
+
 /*
- * This function opens a camera depending on the specified model and port.
+ * Same as gp_camera_autodetect(), but against the shared abilities list
+ * instead of loading every camlib again on each call.
  */
+int autodetectCameras (CameraList *list, GPContext *context) {
+	CameraAbilitiesList *abilities = getSharedAbilitiesList();
+	if (!abilities) return GP_ERROR_LIBRARY;
+
+	std::shared_ptr<GPPortInfoList> ports = loadPortInfoList();
+	if (!ports) return GP_ERROR_IO;
+	{
+		std::lock_guard<std::mutex> lock (portInfoMutex);
+		sharedPortInfo = ports;
+	}
 
-static GPPortInfoList		*portinfolist = NULL;
-static CameraAbilitiesList	*abilities = NULL;
+	CameraList *detected = NULL;
+	int ret = gp_list_new (&detected);
+	if (ret < GP_OK) return ret;
+	ret = gp_abilities_list_detect (abilities, ports.get(), detected, context);
+	if (ret < GP_OK) {
+		gp_list_free (detected);
+		return ret;
+	}
+
+	/* drop the generic "usb:" entry, the specific usb:xxx,yyy ports are listed as well */
+	int count = gp_list_count (detected);
+	for (int i = 0; i < count; i++) {
+		const char *name, *value;
+		gp_list_get_name (detected, i, &name);
+		gp_list_get_value (detected, i, &value);
+		if (!strcmp ("usb:", value)) continue;
+		gp_list_append (list, name, value);
+	}
+	gp_list_free (detected);
+	return gp_list_count (list);
+}
+
+bool isConnectionError (int result) {
+	switch (result) {
+	case GP_ERROR_IO:
+	case GP_ERROR_IO_INIT:
+	case GP_ERROR_IO_READ:
+	case GP_ERROR_IO_WRITE:
+	case GP_ERROR_IO_UPDATE:
+	case GP_ERROR_IO_USB_FIND:
+	case GP_ERROR_IO_USB_CLAIM:
+	case GP_ERROR_IO_LOCK:
+	case GP_ERROR_MODEL_NOT_FOUND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * This function opens a camera depending on the specified model and port.
+ */
 
 /*
  * This function looks up a label or key entry of
@@ -24,7 +138,7 @@ _lookup_widget(CameraWidget*widget, const char *key, CameraWidget **child) {
 	return ret;
 }
 
-int sampleOpenCamera (Camera ** camera, const char *model, const char *port, GPContext *context) {
+int sampleOpenCamera (Camera ** camera, const char *model, const char *port, GPContext *) {
 	int		ret, m, p;
 	CameraAbilities	a;
 	GPPortInfo	pi;
@@ -32,34 +146,24 @@ int sampleOpenCamera (Camera ** camera, const char *model, const char *port, GPC
 	ret = gp_camera_new (camera);
 	if (ret < GP_OK) return ret;
 
-	if (!abilities) {
-		/* Load all the camera drivers we have... */
-		ret = gp_abilities_list_new (&abilities);
-		if (ret < GP_OK) return ret;
-		ret = gp_abilities_list_load (abilities, context);
-		if (ret < GP_OK) return ret;
-	}
+	/* All the camera drivers we have... */
+	CameraAbilitiesList *abilities = getSharedAbilitiesList();
+	if (!abilities) return GP_ERROR_LIBRARY;
 
 	/* First lookup the model / driver */
         m = gp_abilities_list_lookup_model (abilities, model);
-	if (m < GP_OK) return ret;
+	if (m < GP_OK) return m;
         ret = gp_abilities_list_get_abilities (abilities, m, &a);
 	if (ret < GP_OK) return ret;
         ret = gp_camera_set_abilities (*camera, a);
 	if (ret < GP_OK) return ret;
 
-	if (!portinfolist) {
-		/* Load all the port drivers we have... */
-		ret = gp_port_info_list_new (&portinfolist);
-		if (ret < GP_OK) return ret;
-		ret = gp_port_info_list_load (portinfolist);
-		if (ret < 0) return ret;
-		ret = gp_port_info_list_count (portinfolist);
-		if (ret < 0) return ret;
-	}
+	/* ...and all the port drivers */
+	std::shared_ptr<GPPortInfoList> portinfolist = getSharedPortInfoList();
+	if (!portinfolist) return GP_ERROR_IO;
 
 	/* Then associate the camera with the specified port */
-        p = gp_port_info_list_lookup_path (portinfolist, port);
+        p = gp_port_info_list_lookup_path (portinfolist.get(), port);
         switch (p) {
         case GP_ERROR_UNKNOWN_PORT:
 			ofLogError()<< "The port you specified "
@@ -75,7 +179,7 @@ int sampleOpenCamera (Camera ** camera, const char *model, const char *port, GPC
         }
         if (p < GP_OK) return p;
 
-        ret = gp_port_info_list_get_info (portinfolist, p, &pi);
+        ret = gp_port_info_list_get_info (portinfolist.get(), p, &pi);
         if (ret < GP_OK) return ret;
         ret = gp_camera_set_port_info (*camera, pi);
         if (ret < GP_OK) return ret;
@@ -2,10 +2,33 @@
 #define GPHOTOHELPERFUNCTIONS_H
 
 #include <gphoto2/gphoto2-camera.h>
+#include <memory>
+#include <string>
 #include "ofLog.h"
 
 
 namespace ofxGphoto{
+    /*
+     * Camera driver and port lists shared by every camera in the process.
+     * The abilities list (every camlib) is loaded once on first use. The port
+     * list is reloaded by autodetectCameras() so newly plugged cameras show up,
+     * callers hold on to the shared_ptr while they look ports up.
+     */
+    CameraAbilitiesList* getSharedAbilitiesList();
+    std::shared_ptr<GPPortInfoList> getSharedPortInfoList();
+    int autodetectCameras (CameraList *list, GPContext *context);
+
+    /*
+     * The port each serial number was last seen on, remembered whenever a
+     * camera is opened or probed. Binding by serial tries that port first
+     * instead of opening every detected camera. Empty if it is unknown.
+     */
+    void rememberSerialPort (const std::string& serial, const std::string& port);
+    std::string getRememberedPort (const std::string& serial);
+
+    // true for errors that mean the camera went away rather than a failed request
+    bool isConnectionError (int result);
+
     int sampleOpenCamera (Camera ** camera, const char *model, const char *port, GPContext *context) ;
     int getConfigValueString (Camera *camera, const char *key, char **str, GPContext *context);
 }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxGphoto {
+	struct JitterReport {
+		unsigned int samples;
+		float meanMs;
+		float stdDevMs; // the jitter
+		float minMs;
+		float maxMs;
+		float p99Ms; // 99th percentile
+	};
+
+	/*
+	 Keeps the last few samples of something that should be regular, like the
+	 time between two live view polls or how late a thread woke up, and
+	 summarizes their spread. Not thread safe, the owner guards it.
+	 */
+	class JitterMeter {
+	protected:
+		vector<float> samples;
+		unsigned int next, count;
+	public:
+		JitterMeter(unsigned int size = 512) :
+		samples(size),
+		next(0),
+		count(0) {
+		}
+		void reset() {
+			next = 0, count = 0;
+		}
+		void add(float ms) {
+			samples[next] = ms;
+			next = (next + 1) % samples.size();
+			count = min<unsigned int>(count + 1, samples.size());
+		}
+		JitterReport getReport() const {
+			JitterReport report = JitterReport();
+			report.samples = count;
+			if(count == 0) {
+				return report;
+			}
+			vector<float> sorted(samples.begin(), samples.begin() + count);
+			sort(sorted.begin(), sorted.end());
+			double sum = 0, sumSquares = 0;
+			for(float ms:sorted) {
+				sum += ms;
+				sumSquares += ms * ms;
+			}
+			double mean = sum / count;
+			report.meanMs = mean;
+			report.stdDevMs = sqrt(max(0., sumSquares / count - mean * mean));
+			report.minMs = sorted.front();
+			report.maxMs = sorted.back();
+			report.p99Ms = sorted[min<size_t>(count - 1, count * 99 / 100)];
+			return report;
+		}
+	};
+}
@@ -0,0 +1,509 @@
+#include "LiveAnalyzer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define OFX_GPHOTO_SSE2
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define OFX_GPHOTO_SSSE3
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OFX_GPHOTO_NEON
+#endif
+
+// Rec. 601 luma weights in 8 bit fixed point, they add up to 256
+#define OFX_GPHOTO_LUMA_R 77
+#define OFX_GPHOTO_LUMA_G 150
+#define OFX_GPHOTO_LUMA_B 29
+
+namespace ofxGphoto {
+
+	/*
+	 Splits a row of interleaved rgb into planes and computes luma. The SIMD
+	 paths handle 16 pixels at a time, the rest is done one by one.
+	 */
+	static void splitRow(const unsigned char *rgb, size_t n, unsigned char *r, unsigned char *g, unsigned char *b, unsigned char *y) {
+		size_t i = 0;
+#if defined(OFX_GPHOTO_NEON)
+		for(; i + 16 <= n; i += 16) {
+			uint8x16x3_t px = vld3q_u8(rgb + i * 3);
+			vst1q_u8(r + i, px.val[0]);
+			vst1q_u8(g + i, px.val[1]);
+			vst1q_u8(b + i, px.val[2]);
+			uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(OFX_GPHOTO_LUMA_R));
+			lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(OFX_GPHOTO_LUMA_G));
+			lo = vmlal_u8(lo, vget_low_u8(px.val[2]), vdup_n_u8(OFX_GPHOTO_LUMA_B));
+			uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(OFX_GPHOTO_LUMA_R));
+			hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(OFX_GPHOTO_LUMA_G));
+			hi = vmlal_u8(hi, vget_high_u8(px.val[2]), vdup_n_u8(OFX_GPHOTO_LUMA_B));
+			vst1q_u8(y + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+		}
+#elif defined(OFX_GPHOTO_SSSE3)
+		const __m128i ra = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i rb = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+		const __m128i rc = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+		const __m128i ga = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i gb = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+		const __m128i gc = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+		const __m128i ba = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i bb = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+		const __m128i bc = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i wr = _mm_set1_epi16(OFX_GPHOTO_LUMA_R);
+		const __m128i wg = _mm_set1_epi16(OFX_GPHOTO_LUMA_G);
+		const __m128i wb = _mm_set1_epi16(OFX_GPHOTO_LUMA_B);
+		for(; i + 16 <= n; i += 16) {
+			const __m128i *src = (const __m128i*) (rgb + i * 3);
+			__m128i a = _mm_loadu_si128(src);
+			__m128i bv = _mm_loadu_si128(src + 1);
+			__m128i c = _mm_loadu_si128(src + 2);
+			__m128i rv = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, ra), _mm_shuffle_epi8(bv, rb)), _mm_shuffle_epi8(c, rc));
+			__m128i gv = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, ga), _mm_shuffle_epi8(bv, gb)), _mm_shuffle_epi8(c, gc));
+			__m128i bl = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, ba), _mm_shuffle_epi8(bv, bb)), _mm_shuffle_epi8(c, bc));
+			_mm_storeu_si128((__m128i*) (r + i), rv);
+			_mm_storeu_si128((__m128i*) (g + i), gv);
+			_mm_storeu_si128((__m128i*) (b + i), bl);
+			// the weighted sum stays below 65536, so unsigned 16 bit lanes are enough
+			__m128i lo = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(rv, zero), wr),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(gv, zero), wg)),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(bl, zero), wb));
+			__m128i hi = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(rv, zero), wr),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(gv, zero), wg)),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(bl, zero), wb));
+			_mm_storeu_si128((__m128i*) (y + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+		}
+#endif
+		for(; i < n; i++) {
+			r[i] = rgb[i * 3];
+			g[i] = rgb[i * 3 + 1];
+			b[i] = rgb[i * 3 + 2];
+			y[i] = (r[i] * OFX_GPHOTO_LUMA_R + g[i] * OFX_GPHOTO_LUMA_G + b[i] * OFX_GPHOTO_LUMA_B) >> 8;
+		}
+	}
+
+	/*
+	 Counts pixels with any channel at or above highlights, and pixels with
+	 every channel at or below shadows.
+	 */
+	static void countClipped(const unsigned char *r, const unsigned char *g, const unsigned char *b, size_t n,
+			unsigned char shadows, unsigned char highlights, uint64_t& clippedShadows, uint64_t& clippedHighlights) {
+		size_t i = 0;
+#if defined(OFX_GPHOTO_NEON)
+		const uint8x16_t lowV = vdupq_n_u8(shadows);
+		const uint8x16_t highV = vdupq_n_u8(highlights);
+		uint16x8_t lowCount = vdupq_n_u16(0);
+		uint16x8_t highCount = vdupq_n_u16(0);
+		size_t blocks = 0;
+		for(; i + 16 <= n; i += 16) {
+			uint8x16_t rv = vld1q_u8(r + i), gv = vld1q_u8(g + i), bv = vld1q_u8(b + i);
+			uint8x16_t mx = vmaxq_u8(vmaxq_u8(rv, gv), bv);
+			// each lane adds 0 or 1, flush before the 16 bit counters could overflow
+			highCount = vpadalq_u8(highCount, vshrq_n_u8(vcgeq_u8(mx, highV), 7));
+			lowCount = vpadalq_u8(lowCount, vshrq_n_u8(vcleq_u8(mx, lowV), 7));
+			if(++blocks == 4096 || i + 32 > n) {
+				uint64x2_t h = vpaddlq_u32(vpaddlq_u16(highCount));
+				uint64x2_t l = vpaddlq_u32(vpaddlq_u16(lowCount));
+				clippedHighlights += vgetq_lane_u64(h, 0) + vgetq_lane_u64(h, 1);
+				clippedShadows += vgetq_lane_u64(l, 0) + vgetq_lane_u64(l, 1);
+				highCount = lowCount = vdupq_n_u16(0);
+				blocks = 0;
+			}
+		}
+#elif defined(OFX_GPHOTO_SSE2)
+		const __m128i lowV = _mm_set1_epi8((char) shadows);
+		const __m128i highV = _mm_set1_epi8((char) highlights);
+		for(; i + 16 <= n; i += 16) {
+			__m128i rv = _mm_loadu_si128((const __m128i*) (r + i));
+			__m128i gv = _mm_loadu_si128((const __m128i*) (g + i));
+			__m128i bv = _mm_loadu_si128((const __m128i*) (b + i));
+			// the brightest channel decides both: any channel high, or all of them low
+			__m128i mx = _mm_max_epu8(_mm_max_epu8(rv, gv), bv);
+			// unsigned compares: x >= high exactly when max(x, high) == x
+			int high = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(mx, highV), mx));
+			int low = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(mx, lowV), mx));
+			clippedHighlights += __builtin_popcount(high);
+			clippedShadows += __builtin_popcount(low);
+		}
+#endif
+		for(; i < n; i++) {
+			clippedHighlights += r[i] >= highlights || g[i] >= highlights || b[i] >= highlights;
+			clippedShadows += r[i] <= shadows && g[i] <= shadows && b[i] <= shadows;
+		}
+	}
+
+	/*
+	 Gradient magnitude |dx| + |dy| of one luma row from central differences,
+	 saturated to 255. The first and last pixel have no neighbours and get 0.
+	 */
+	static void gradientMagnitude(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+			size_t n, unsigned char *magnitude) {
+		if(n < 3) {
+			memset(magnitude, 0, n);
+			return;
+		}
+		magnitude[0] = magnitude[n - 1] = 0;
+		size_t i = 1;
+#if defined(OFX_GPHOTO_NEON)
+		for(; i + 17 <= n; i += 16) {
+			uint8x16_t dx = vabdq_u8(vld1q_u8(row + i + 1), vld1q_u8(row + i - 1));
+			uint8x16_t dy = vabdq_u8(vld1q_u8(below + i), vld1q_u8(above + i));
+			vst1q_u8(magnitude + i, vqaddq_u8(dx, dy));
+		}
+#elif defined(OFX_GPHOTO_SSE2)
+		for(; i + 17 <= n; i += 16) {
+			__m128i left = _mm_loadu_si128((const __m128i*) (row + i - 1));
+			__m128i right = _mm_loadu_si128((const __m128i*) (row + i + 1));
+			__m128i up = _mm_loadu_si128((const __m128i*) (above + i));
+			__m128i down = _mm_loadu_si128((const __m128i*) (below + i));
+			// unsigned absolute difference, one of the two saturated subtractions is 0
+			__m128i dx = _mm_or_si128(_mm_subs_epu8(right, left), _mm_subs_epu8(left, right));
+			__m128i dy = _mm_or_si128(_mm_subs_epu8(down, up), _mm_subs_epu8(up, down));
+			_mm_storeu_si128((__m128i*) (magnitude + i), _mm_adds_epu8(dx, dy));
+		}
+#endif
+		for(; i < n - 1; i++) {
+			int dx = abs(row[i + 1] - row[i - 1]);
+			int dy = abs(below[i] - above[i]);
+			magnitude[i] = min(dx + dy, 255);
+		}
+	}
+
+	static uint64_t sumSquares(const unsigned char *values, size_t n) {
+		uint64_t sum = 0;
+		size_t i = 0;
+#if defined(OFX_GPHOTO_NEON)
+		uint32x4_t acc = vdupq_n_u32(0);
+		for(; i + 16 <= n; i += 16) {
+			uint8x16_t v = vld1q_u8(values + i);
+			acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(v), vget_low_u8(v)));
+			acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(v), vget_high_u8(v)));
+		}
+		uint64x2_t total = vpaddlq_u32(acc);
+		sum += vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1);
+#elif defined(OFX_GPHOTO_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = zero;
+		for(; i + 16 <= n; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (values + i));
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+		}
+		uint32_t lanes[4];
+		_mm_storeu_si128((__m128i*) lanes, acc);
+		sum += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for(; i < n; i++) {
+			sum += values[i] * values[i];
+		}
+		return sum;
+	}
+
+	LiveAnalyzer::LiveAnalyzer() :
+	running(false),
+	threadSettingsVersion(0),
+	hasPending(false),
+	hasDecoded(false),
+	frames(0),
+	dropped(0),
+	shadows(2),
+	highlights(253),
+	focusAnalysis(false),
+	maskDownscale(4),
+	focusRoi(0, 0, 1, 1),
+	peakingThreshold(48),
+	hasFocusMask(false) {
+		stats = LiveStats();
+	}
+
+	LiveAnalyzer::~LiveAnalyzer() {
+		close();
+	}
+
+	void LiveAnalyzer::setup() {
+		close();
+		unique_lock<mutex> lock(frameMutex);
+		running = true;
+		worker = thread(&LiveAnalyzer::workerLoop, this);
+	}
+
+	bool LiveAnalyzer::isSetup() const {
+		return running;
+	}
+
+	void LiveAnalyzer::close() {
+		{
+			unique_lock<mutex> lock(frameMutex);
+			if(!running) {
+				return;
+			}
+			running = false;
+		}
+		frameAvailable.notify_all();
+		worker.join();
+		hasPending = false;
+		hasDecoded = false;
+	}
+
+	void LiveAnalyzer::setClipping(unsigned char shadows, unsigned char highlights) {
+		unique_lock<mutex> lock(frameMutex);
+		this->shadows = shadows;
+		this->highlights = highlights;
+	}
+
+	void LiveAnalyzer::setThreadSettings(const ThreadSettings& threadSettings) {
+		unique_lock<mutex> lock(frameMutex);
+		this->threadSettings = threadSettings;
+		threadSettingsVersion++;
+	}
+
+	void LiveAnalyzer::setFocusAnalysis(bool focusAnalysis, int maskDownscale) {
+		unique_lock<mutex> lock(frameMutex);
+		this->focusAnalysis = focusAnalysis;
+		this->maskDownscale = max(maskDownscale, 1);
+		if(!focusAnalysis) {
+			hasFocusMask = false;
+		}
+	}
+
+	void LiveAnalyzer::setFocusRoi(const ofRectangle& roi) {
+		unique_lock<mutex> lock(frameMutex);
+		focusRoi = roi;
+	}
+
+	void LiveAnalyzer::setPeakingThreshold(unsigned char peakingThreshold) {
+		unique_lock<mutex> lock(frameMutex);
+		this->peakingThreshold = peakingThreshold;
+	}
+
+	bool LiveAnalyzer::getFocusMask(ofPixels& mask) {
+		unique_lock<mutex> lock(frameMutex);
+		if(!hasFocusMask) {
+			return false;
+		}
+		mask = focusMask;
+		return true;
+	}
+
+	void LiveAnalyzer::push(ofBuffer& jpeg) {
+		unique_lock<mutex> lock(frameMutex);
+		if(hasPending) {
+			dropped++;
+		}
+		std::swap(pending, jpeg);
+		hasPending = true;
+		lock.unlock();
+		frameAvailable.notify_one();
+	}
+
+	bool LiveAnalyzer::popFrame(ofPixels& pixels) {
+		unique_lock<mutex> lock(frameMutex);
+		if(!hasDecoded) {
+			return false;
+		}
+		// the caller's old pixels come back to the worker to decode into
+		pixels.swap(decoded);
+		hasDecoded = false;
+		return true;
+	}
+
+	LiveStats LiveAnalyzer::getStats() {
+		unique_lock<mutex> lock(frameMutex);
+		return stats;
+	}
+
+	unsigned int LiveAnalyzer::getDroppedCount() {
+		unique_lock<mutex> lock(frameMutex);
+		return dropped;
+	}
+
+	void LiveAnalyzer::workerLoop() {
+		ofBuffer jpeg;
+		unsigned int appliedVersion = 0;
+		while(true) {
+			unique_lock<mutex> lock(frameMutex);
+			frameAvailable.wait(lock, [this] { return hasPending || !running; });
+			if(!running) {
+				return;
+			}
+			std::swap(jpeg, pending);
+			hasPending = false;
+			unsigned int frame = ++frames;
+			ThreadSettings settings = threadSettings;
+			bool settingsChanged = appliedVersion != threadSettingsVersion;
+			appliedVersion = threadSettingsVersion;
+			lock.unlock();
+
+			if(settingsChanged) {
+				applyThreadSettings(settings, "ofxGphoto::LiveAnalyzer");
+			}
+
+			uint64_t start = ofGetElapsedTimeMicros();
+			if(!ofLoadImage(working, jpeg)) {
+				continue;
+			}
+			uint64_t decodedTime = ofGetElapsedTimeMicros();
+			LiveStats frameStats;
+			frameStats.frame = frame;
+			analyze(working, frameStats);
+			frameStats.decodeMs = (decodedTime - start) / 1000.f;
+			frameStats.analysisMs = (ofGetElapsedTimeMicros() - decodedTime) / 1000.f;
+
+			lock.lock();
+			working.swap(decoded);
+			hasDecoded = true;
+			if(frameStats.sharpness >= 0) {
+				workingMask.swap(focusMask);
+				hasFocusMask = true;
+			}
+			stats = frameStats;
+			lock.unlock();
+			ofNotifyEvent(analyzed, frameStats);
+		}
+	}
+
+	/*
+	 One pass per row: split into planes and luma (SIMD), count clipped
+	 pixels (SIMD), then fill the histograms. Each channel is counted into two
+	 banks, alternating per pixel, so neighbouring pixels with the same value
+	 don't wait on each other's increment. Means come from the histograms.
+	 */
+	void LiveAnalyzer::analyze(const ofPixels& pixels, LiveStats& stats) {
+		size_t width = pixels.getWidth();
+		size_t height = pixels.getHeight();
+		stats.width = width;
+		stats.height = height;
+		memset(stats.histogram, 0, sizeof(stats.histogram));
+		for(int c = 0; c < LIVE_CHANNEL_COUNT; c++) {
+			stats.mean[c] = 0;
+		}
+		stats.clippedHighlights = stats.clippedShadows = 0;
+		stats.sharpness = -1;
+		if(pixels.getNumChannels() != 3 || width == 0 || height == 0) {
+			return;
+		}
+
+		unsigned char shadows, highlights;
+		{
+			unique_lock<mutex> lock(frameMutex);
+			shadows = this->shadows;
+			highlights = this->highlights;
+		}
+
+		luma.resize(width * height);
+		rgbRows.resize(width * 3);
+		unsigned char *r = &rgbRows[0];
+		unsigned char *g = r + width;
+		unsigned char *b = g + width;
+		vector<uint32_t> banks(LIVE_CHANNEL_COUNT * 2 * 256, 0);
+		uint32_t *bank[LIVE_CHANNEL_COUNT][2];
+		for(int c = 0; c < LIVE_CHANNEL_COUNT; c++) {
+			bank[c][0] = &banks[c * 512];
+			bank[c][1] = &banks[c * 512 + 256];
+		}
+		uint64_t clippedShadows = 0, clippedHighlights = 0;
+		const unsigned char *data = pixels.getData();
+		for(size_t row = 0; row < height; row++) {
+			unsigned char *y = &luma[row * width];
+			splitRow(data + row * width * 3, width, r, g, b, y);
+			countClipped(r, g, b, width, shadows, highlights, clippedShadows, clippedHighlights);
+			size_t i = 0;
+			for(; i + 2 <= width; i += 2) {
+				bank[LIVE_LUMA][0][y[i]]++;
+				bank[LIVE_LUMA][1][y[i + 1]]++;
+				bank[LIVE_RED][0][r[i]]++;
+				bank[LIVE_RED][1][r[i + 1]]++;
+				bank[LIVE_GREEN][0][g[i]]++;
+				bank[LIVE_GREEN][1][g[i + 1]]++;
+				bank[LIVE_BLUE][0][b[i]]++;
+				bank[LIVE_BLUE][1][b[i + 1]]++;
+			}
+			if(i < width) {
+				bank[LIVE_LUMA][0][y[i]]++;
+				bank[LIVE_RED][0][r[i]]++;
+				bank[LIVE_GREEN][0][g[i]]++;
+				bank[LIVE_BLUE][0][b[i]]++;
+			}
+		}
+
+		float count = width * height;
+		for(int c = 0; c < LIVE_CHANNEL_COUNT; c++) {
+			uint64_t sum = 0;
+			for(int v = 0; v < 256; v++) {
+				stats.histogram[c][v] = bank[c][0][v] + bank[c][1][v];
+				sum += (uint64_t) v * stats.histogram[c][v];
+			}
+			stats.mean[c] = sum / count;
+		}
+		stats.clippedHighlights = clippedHighlights / count;
+		stats.clippedShadows = clippedShadows / count;
+
+		analyzeFocus(width, height, stats);
+	}
+
+	/*
+	 Works on the luma plane analyze() just filled. Every row gets its
+	 gradient magnitude (SIMD), the part inside the roi adds its squares to
+	 the energy (SIMD) and each mask pixel keeps the strongest gradient of its
+	 block.
+	 */
+	void LiveAnalyzer::analyzeFocus(size_t width, size_t height, LiveStats& stats) {
+		int downscale;
+		ofRectangle roi;
+		unsigned char threshold;
+		{
+			unique_lock<mutex> lock(frameMutex);
+			if(!focusAnalysis) {
+				return;
+			}
+			downscale = maskDownscale;
+			roi = focusRoi;
+			threshold = peakingThreshold;
+		}
+		if(width < 3 || height < 3) {
+			return;
+		}
+
+		size_t x0 = ofClamp(roi.x * width, 1, width - 1);
+		size_t x1 = ofClamp((roi.x + roi.width) * width, x0, width - 1);
+		size_t y0 = ofClamp(roi.y * height, 1, height - 1);
+		size_t y1 = ofClamp((roi.y + roi.height) * height, y0, height - 1);
+
+		size_t maskWidth = max(width / downscale, (size_t) 1);
+		size_t maskHeight = max(height / downscale, (size_t) 1);
+		if(workingMask.getWidth() != maskWidth || workingMask.getHeight() != maskHeight) {
+			workingMask.allocate(maskWidth, maskHeight, 1);
+		}
+		workingMask.set(0);
+		unsigned char *mask = workingMask.getData();
+
+		gradientRow.resize(width);
+		unsigned char *magnitude = &gradientRow[0];
+		uint64_t energy = 0;
+		for(size_t row = 1; row + 1 < height; row++) {
+			const unsigned char *y = &luma[row * width];
+			gradientMagnitude(y - width, y, y + width, width, magnitude);
+			if(row >= y0 && row < y1 && x1 > x0) {
+				energy += sumSquares(magnitude + x0, x1 - x0);
+			}
+			size_t maskRow = row / downscale;
+			if(maskRow >= maskHeight) {
+				continue;
+			}
+			unsigned char *out = mask + maskRow * maskWidth;
+			for(size_t x = 0; x < maskWidth * downscale; x++) {
+				unsigned char m = magnitude[x];
+				unsigned char& o = out[x / downscale];
+				if(m >= threshold && m > o) {
+					o = m;
+				}
+			}
+		}
+		size_t roiPixels = (x1 - x0) * (y1 - y0);
+		stats.sharpness = roiPixels > 0 ? (float) energy / roiPixels : 0;
+	}
+}
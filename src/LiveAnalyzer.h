@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ThreadSettings.h"
+
+namespace ofxGphoto {
+
+	enum LiveChannel {
+		LIVE_LUMA,
+		LIVE_RED,
+		LIVE_GREEN,
+		LIVE_BLUE,
+		LIVE_CHANNEL_COUNT
+	};
+
+	struct LiveStats {
+		unsigned int frame; // counts the frames handed to the analyzer
+		unsigned int width;
+		unsigned int height;
+		unsigned int histogram[LIVE_CHANNEL_COUNT][256];
+		float mean[LIVE_CHANNEL_COUNT]; // 0-255
+		float clippedHighlights; // fraction of pixels with any channel at or above the highlight level
+		float clippedShadows; // fraction of pixels with every channel at or below the shadow level
+		float sharpness; // mean squared luma gradient inside the focus roi, -1 without focus analysis
+		float decodeMs;
+		float analysisMs;
+	};
+
+	/*
+	 LiveAnalyzer decodes live view jpegs on its own thread and measures each
+	 frame right after decoding: luma and rgb histograms, means and clipping,
+	 and with focus analysis a sharpness score and a focus peaking mask.
+	 Only the newest frame matters, so push() replaces a frame the worker
+	 hasn't started on yet. The analyzed event is notified on the worker.
+	 */
+	class LiveAnalyzer {
+	public:
+		LiveAnalyzer();
+		~LiveAnalyzer();
+
+		void setup();
+		bool isSetup() const;
+		void close();
+		void setClipping(unsigned char shadows, unsigned char highlights);
+		void setThreadSettings(const ThreadSettings& threadSettings); // the worker picks them up with its next frame
+
+		/*
+		 Focus analysis scores the gradient energy of the luma inside roi
+		 (normalized, the whole frame by default) and builds an edge mask
+		 maskDownscale times smaller than the frame. Mask pixels are the
+		 strongest gradient in their block, 0 below peakingThreshold.
+		 */
+		void setFocusAnalysis(bool focusAnalysis, int maskDownscale = 4);
+		void setFocusRoi(const ofRectangle& roi);
+		void setPeakingThreshold(unsigned char peakingThreshold);
+		bool getFocusMask(ofPixels& mask); // copy of the newest mask, false if there is none
+
+		void push(ofBuffer& jpeg); // takes the jpeg, leaves an old buffer for reuse
+		bool popFrame(ofPixels& pixels); // the newest decoded frame, false if there is none
+		LiveStats getStats();
+		unsigned int getDroppedCount();
+
+		ofEvent<LiveStats> analyzed;
+
+	private:
+		void workerLoop();
+		void analyze(const ofPixels& pixels, LiveStats& stats);
+		void analyzeFocus(size_t width, size_t height, LiveStats& stats);
+
+		thread worker;
+		mutex frameMutex;
+		condition_variable frameAvailable;
+		bool running;
+		ThreadSettings threadSettings;
+		unsigned int threadSettingsVersion;
+
+		ofBuffer pending;
+		bool hasPending;
+		ofPixels decoded;
+		bool hasDecoded;
+		unsigned int frames;
+		unsigned int dropped;
+		LiveStats stats;
+
+		unsigned char shadows;
+		unsigned char highlights;
+		bool focusAnalysis;
+		int maskDownscale;
+		ofRectangle focusRoi;
+		unsigned char peakingThreshold;
+		ofPixels focusMask;
+		bool hasFocusMask;
+
+		// only touched by the worker
+		ofPixels working;
+		vector<unsigned char> luma;
+		vector<unsigned char> rgbRows;
+		vector<unsigned char> gradientRow;
+		ofPixels workingMask;
+	};
+}
@@ -0,0 +1,208 @@
+#include "PhotoWriter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ofxGphoto {
+
+	PhotoWriter::PhotoWriter() :
+	activeJobs(0),
+	running(false),
+	threadSettingsVersion(0),
+	maxPendingBytes(256 << 20),
+	syncPolicy(SYNC_NONE) {
+		stats = PhotoWriterStats();
+	}
+
+	PhotoWriter::~PhotoWriter() {
+		close();
+	}
+
+	void PhotoWriter::setup(int numThreads, size_t maxPendingBytes, SyncPolicy syncPolicy) {
+		close();
+		unique_lock<mutex> lock(jobMutex);
+		this->maxPendingBytes = maxPendingBytes;
+		this->syncPolicy = syncPolicy;
+		running = true;
+		for(int i = 0; i < max(numThreads, 1); i++) {
+			threads.emplace_back(&PhotoWriter::writerLoop, this);
+		}
+	}
+
+	bool PhotoWriter::isSetup() const {
+		return running;
+	}
+
+	void PhotoWriter::setSyncPolicy(SyncPolicy syncPolicy) {
+		unique_lock<mutex> lock(jobMutex);
+		this->syncPolicy = syncPolicy;
+	}
+
+	void PhotoWriter::setThreadSettings(const ThreadSettings& threadSettings) {
+		unique_lock<mutex> lock(jobMutex);
+		this->threadSettings = threadSettings;
+		threadSettingsVersion++;
+	}
+
+	bool PhotoWriter::save(const string& filename, const ofBuffer& buffer) {
+		unique_lock<mutex> lock(jobMutex);
+		if(!running) {
+			ofLogError("ofxGphoto::PhotoWriter") << "save() called before setup()";
+			return false;
+		}
+		if(stats.bytesPending + buffer.size() > maxPendingBytes) {
+			stats.rejected++;
+			lock.unlock();
+			ofLogWarning("ofxGphoto::PhotoWriter") << "write queue is full, dropping " << filename;
+			return false;
+		}
+		jobs.push_back(Job());
+		jobs.back().filename = filename;
+		jobs.back().buffer = buffer;
+		jobs.back().queuedTime = ofGetElapsedTimef();
+		stats.queued++;
+		stats.bytesPending += buffer.size();
+		lock.unlock();
+		jobAvailable.notify_one();
+		return true;
+	}
+
+	void PhotoWriter::flush() {
+		unique_lock<mutex> lock(jobMutex);
+		jobDone.wait(lock, [this] { return jobs.empty() && activeJobs == 0; });
+	}
+
+	void PhotoWriter::close() {
+		{
+			unique_lock<mutex> lock(jobMutex);
+			if(!running) {
+				return;
+			}
+		}
+		flush();
+		{
+			unique_lock<mutex> lock(jobMutex);
+			running = false;
+		}
+		jobAvailable.notify_all();
+		for(auto& t:threads) {
+			t.join();
+		}
+		threads.clear();
+	}
+
+	PhotoWriterStats PhotoWriter::getStats() {
+		unique_lock<mutex> lock(jobMutex);
+		return stats;
+	}
+
+	bool PhotoWriter::writeFile(const Job& job, int& fd) {
+		fd = ::open(job.filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			ofLogError("ofxGphoto::PhotoWriter") << "cannot open " << job.filename << ": " << strerror(errno);
+			return false;
+		}
+		const char* data = job.buffer.getData();
+		size_t remaining = job.buffer.size();
+		while(remaining > 0) {
+			ssize_t written = ::write(fd, data, remaining);
+			if(written < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				ofLogError("ofxGphoto::PhotoWriter") << "cannot write " << job.filename << ": " << strerror(errno);
+				return false;
+			}
+			data += written;
+			remaining -= written;
+		}
+		return true;
+	}
+
+	/*
+	 Each writer takes everything that is queued as one batch. With SYNC_BATCH the
+	 files stay open until the whole batch is written and are then synced
+	 together, which lets the filesystem merge the flushes.
+	 */
+	void PhotoWriter::writerLoop() {
+		unsigned int appliedVersion = 0;
+		while(true) {
+			unique_lock<mutex> lock(jobMutex);
+			jobAvailable.wait(lock, [this] { return !jobs.empty() || !running; });
+			if(jobs.empty()) {
+				return;
+			}
+			vector<Job> batch;
+			SyncPolicy policy = syncPolicy;
+			if(policy == SYNC_BATCH) {
+				while(!jobs.empty()) {
+					batch.push_back(move(jobs.front()));
+					jobs.pop_front();
+				}
+			} else {
+				batch.push_back(move(jobs.front()));
+				jobs.pop_front();
+			}
+			activeJobs += batch.size();
+			ThreadSettings settings = threadSettings;
+			bool settingsChanged = appliedVersion != threadSettingsVersion;
+			appliedVersion = threadSettingsVersion;
+			lock.unlock();
+
+			if(settingsChanged) {
+				applyThreadSettings(settings, "ofxGphoto::PhotoWriter");
+			}
+
+			float startTime = ofGetElapsedTimef();
+			vector<int> fds(batch.size(), -1);
+			vector<bool> success(batch.size(), false);
+			for(size_t i = 0; i < batch.size(); i++) {
+				success[i] = writeFile(batch[i], fds[i]);
+				if(success[i] && policy == SYNC_FILE) {
+#ifdef __APPLE__
+					success[i] = fcntl(fds[i], F_FULLFSYNC) == 0;
+#else
+					success[i] = fdatasync(fds[i]) == 0;
+#endif
+				}
+			}
+			for(size_t i = 0; i < batch.size(); i++) {
+				if(fds[i] < 0) {
+					continue;
+				}
+				if(success[i] && policy == SYNC_BATCH) {
+					success[i] = fsync(fds[i]) == 0;
+				}
+				if(::close(fds[i]) != 0) {
+					success[i] = false;
+				}
+			}
+			float writeSeconds = ofGetElapsedTimef() - startTime;
+
+			for(size_t i = 0; i < batch.size(); i++) {
+				SaveResult result;
+				result.filename = batch[i].filename;
+				result.size = batch[i].buffer.size();
+				result.success = success[i];
+				result.queuedSeconds = startTime - batch[i].queuedTime;
+				result.writeSeconds = writeSeconds;
+				ofNotifyEvent(saved, result);
+			}
+
+			lock.lock();
+			for(size_t i = 0; i < batch.size(); i++) {
+				stats.bytesPending -= batch[i].buffer.size();
+				if(success[i]) {
+					stats.written++;
+					stats.bytesWritten += batch[i].buffer.size();
+				} else {
+					stats.failed++;
+				}
+			}
+			stats.writeSeconds += writeSeconds;
+			activeJobs -= batch.size();
+			lock.unlock();
+			jobDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ThreadSettings.h"
+
+namespace ofxGphoto {
+
+	/*
+	 How hard the writer tries to get a photo onto stable storage before it
+	 reports it as saved.
+	 */
+	enum SyncPolicy {
+		SYNC_NONE, // leave it to the page cache
+		SYNC_FILE, // fdatasync() every file before reporting it
+		SYNC_BATCH // write everything that is queued, then fsync() the whole batch
+	};
+
+	struct SaveResult {
+		string filename;
+		size_t size;
+		bool success;
+		float queuedSeconds; // time spent waiting in the queue
+		float writeSeconds; // time spent writing and syncing
+	};
+
+	struct PhotoWriterStats {
+		unsigned int queued;
+		unsigned int written;
+		unsigned int failed;
+		unsigned int rejected; // dropped because the byte budget was exhausted
+		uint64_t bytesWritten;
+		size_t bytesPending;
+		float writeSeconds;
+		float getThroughput() const { return writeSeconds > 0 ? bytesWritten / writeSeconds : 0; }
+	};
+
+	/*
+	 PhotoWriter writes photos to disk on its own thread(s), so saving never
+	 blocks the thread that asks for it. The queue is bounded by a byte budget:
+	 save() copies the buffer and returns false right away if the copy would not
+	 fit. The saved event is notified on a writer thread once a file is done.
+	 */
+	class PhotoWriter {
+	public:
+		PhotoWriter();
+		~PhotoWriter();
+
+		void setup(int numThreads = 1, size_t maxPendingBytes = 256 << 20, SyncPolicy syncPolicy = SYNC_NONE);
+		bool isSetup() const;
+		void setSyncPolicy(SyncPolicy syncPolicy);
+		void setThreadSettings(const ThreadSettings& threadSettings); // every writer picks them up with its next batch
+		bool save(const string& filename, const ofBuffer& buffer);
+		void flush(); // blocks until everything queued so far is written
+		void close();
+
+		PhotoWriterStats getStats();
+
+		ofEvent<SaveResult> saved;
+
+	private:
+		struct Job {
+			string filename;
+			ofBuffer buffer;
+			float queuedTime;
+		};
+
+		void writerLoop();
+		bool writeFile(const Job& job, int& fd);
+
+		vector<thread> threads;
+		mutex jobMutex;
+		condition_variable jobAvailable;
+		condition_variable jobDone;
+		deque<Job> jobs;
+		unsigned int activeJobs;
+		bool running;
+		ThreadSettings threadSettings;
+		unsigned int threadSettingsVersion;
+
+		size_t maxPendingBytes;
+		SyncPolicy syncPolicy;
+		PhotoWriterStats stats;
+	};
+}
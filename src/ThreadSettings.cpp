@@ -0,0 +1,120 @@
+#include "ThreadSettings.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ofxGphoto {
+
+	static bool setAffinity(const vector<int>& cores, const string& threadName) {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		int cpus = thread::hardware_concurrency();
+		for(int core:cores) {
+			if(core < 0 || (cpus > 0 && core >= cpus) || core >= CPU_SETSIZE) {
+				ofLogWarning("ofxGphoto") << threadName << ": there is no cpu " << core;
+				continue;
+			}
+			CPU_SET(core, &set);
+		}
+		if(CPU_COUNT(&set) == 0) {
+			return false;
+		}
+		int retval = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if(retval != 0) {
+			ofLogWarning("ofxGphoto") << threadName << ": cannot set cpu affinity: " << strerror(retval);
+			return false;
+		}
+		return true;
+#else
+		(void) cores;
+		ofLogWarning("ofxGphoto") << threadName << ": cpu affinity is not supported on this platform";
+		return false;
+#endif
+	}
+
+	static bool setRealtime(SchedulingPolicy policy, int priority, const string& threadName) {
+		int schedPolicy = policy == SCHEDULING_RR ? SCHED_RR : SCHED_FIFO;
+		sched_param param;
+		param.sched_priority = max(sched_get_priority_min(schedPolicy), min(priority, sched_get_priority_max(schedPolicy)));
+		int retval = pthread_setschedparam(pthread_self(), schedPolicy, &param);
+		if(retval != 0) {
+			ofLogWarning("ofxGphoto") << threadName << ": cannot use " << (schedPolicy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO")
+				<< ": " << strerror(retval) << (retval == EPERM ? " (needs CAP_SYS_NICE or an rtprio limit)" : "");
+			return false;
+		}
+		return true;
+	}
+
+	// back to the normal scheduler, in case an earlier call made the thread real time
+	static void setDefaultPolicy() {
+		int policy;
+		sched_param param;
+		if(pthread_getschedparam(pthread_self(), &policy, &param) == 0 && policy != SCHED_OTHER) {
+			param.sched_priority = 0;
+			pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+		}
+	}
+
+	static bool setNice(int nice, const string& threadName) {
+#if defined(__linux__)
+		// on linux the nice level belongs to the thread rather than the process
+		id_t tid = syscall(SYS_gettid);
+		errno = 0;
+		int current = getpriority(PRIO_PROCESS, tid);
+		if(errno == 0 && current == nice) {
+			return true;
+		}
+		if(setpriority(PRIO_PROCESS, tid, nice) != 0) {
+			ofLogWarning("ofxGphoto") << threadName << ": cannot set nice level " << nice << ": " << strerror(errno)
+				<< (nice < 0 && (errno == EACCES || errno == EPERM) ? " (needs CAP_SYS_NICE or a nice limit)" : "");
+			return false;
+		}
+		return true;
+#else
+		if(nice == 0) {
+			// every thread runs at the default level here, nothing to change
+			return true;
+		}
+		ofLogWarning("ofxGphoto") << threadName << ": per thread nice levels are not supported on this platform";
+		return false;
+#endif
+	}
+
+	ThreadSettingsResult applyThreadSettings(const ThreadSettings& settings, const string& threadName) {
+		ThreadSettingsResult result;
+		result.affinity = false;
+		result.realtime = false;
+		result.nice = false;
+		result.success = true;
+
+		if(!settings.cores.empty()) {
+			result.affinity = setAffinity(settings.cores, threadName);
+			result.success &= result.affinity;
+		}
+
+		if(settings.policy != SCHEDULING_DEFAULT) {
+			result.realtime = setRealtime(settings.policy, settings.priority, threadName);
+			result.success &= result.realtime;
+			if(!result.realtime && settings.nice != 0) {
+				ofLogWarning("ofxGphoto") << threadName << ": falling back to nice level " << settings.nice;
+				result.nice = setNice(settings.nice, threadName);
+			}
+		} else {
+			setDefaultPolicy();
+			result.nice = setNice(settings.nice, threadName);
+			result.success &= result.nice;
+		}
+
+		if(result.success) {
+			ofLogVerbose("ofxGphoto") << threadName << ": thread settings applied";
+		}
+		return result;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxGphoto {
+
+	enum SchedulingPolicy {
+		SCHEDULING_DEFAULT, // the normal time sharing scheduler, adjusted by nice
+		SCHEDULING_FIFO, // real time, runs until it blocks or something more urgent wakes up
+		SCHEDULING_RR // real time, round robin between threads of the same priority
+	};
+
+	/*
+	 How a thread should be scheduled. Real time policies need CAP_SYS_NICE or
+	 an rtprio limit (see /etc/security/limits.conf), and negative nice levels
+	 need a nice limit. When the real time policy isn't permitted the thread
+	 falls back to the nice level, so set both to have a fallback.
+	 */
+	struct ThreadSettings {
+		vector<int> cores; // cpus the thread may run on, empty for any
+		SchedulingPolicy policy;
+		int priority; // 1 (lowest) to 99 for the real time policies
+		int nice; // -20 (most favourable) to 19
+		ThreadSettings() :
+		policy(SCHEDULING_DEFAULT),
+		priority(10),
+		nice(0) {
+		}
+		bool isDefault() const {
+			return cores.empty() && policy == SCHEDULING_DEFAULT && nice == 0;
+		}
+	};
+
+	// what applyThreadSettings() managed to do
+	struct ThreadSettingsResult {
+		bool affinity;
+		bool realtime;
+		bool nice;
+		bool success; // everything as asked, fallbacks don't count
+	};
+
+	/*
+	 Applies the settings to the calling thread. Whatever isn't permitted or
+	 supported on this platform is logged as a warning and skipped, the thread
+	 keeps running either way.
+	 */
+	ThreadSettingsResult applyThreadSettings(const ThreadSettings& settings, const string& threadName);
+}
@@ -10,24 +10,116 @@
  */
 #define OFX_GPHOTO_BUFFER_SIZE 1
 
+// Range of the exponential backoff when the camera reports it is busy, in seconds.
+#define OFX_GPHOTO_MIN_BUSY_BACKOFF .02f
+#define OFX_GPHOTO_MAX_BUSY_BACKOFF 1.f
+
+// How many connection errors in a row make us reinitialize the camera.
+#define OFX_GPHOTO_MAX_CONNECTION_ERRORS 3
+
+// How many timeouts or garbled frames in a row make us reset the live view.
+#define OFX_GPHOTO_MAX_LIVE_VIEW_ERRORS 3
+
+// How many live view resets without a good frame make us reopen the camera, twice as many give up.
+#define OFX_GPHOTO_MAX_LIVE_VIEW_RESETS 3
+
+// How long the live view rests after a reset, times the number of resets in a row, in seconds.
+#define OFX_GPHOTO_LIVE_VIEW_RESET_BACKOFF .5f
+
+// How often we try to reinitialize the camera before giving up until requestReconnect().
+#define OFX_GPHOTO_MAX_REINIT_ATTEMPTS 3
+
+// How many finished shot timings getShotTimings() keeps around.
+#define OFX_GPHOTO_SHOT_TIMING_HISTORY 256
+
+// how long after a trigger new files count as its shots, in seconds (covers RAW+JPEG pairs and slow cards)
+#define OFX_GPHOTO_TRIGGER_FILE_WINDOW 10.f
+
+// how long takePhoto(true) waits for the shot and its download
+#define OFX_GPHOTO_CAPTURE_TIMEOUT_MS 30000
+
+// how long close() waits for the capture thread before leaving the rest to it
+#define OFX_GPHOTO_SHUTDOWN_TIMEOUT_MS 2000
+
+// unnamed property change events drop the whole config cache at most this often, in seconds
+#define OFX_GPHOTO_CONFIG_INVALIDATE_INTERVAL 1.f
+
+// longer event waits are cut into slices this long, so a stop request isn't held up
+#define OFX_GPHOTO_EVENT_SLICE_MS 20
+
 namespace ofxGphoto {
 
 GPhoto::GPhoto() :
 	//deviceId(0),
 	//orientationMode(0),
+	useOwnThread(true),
+	captureThreadId(std::thread::id()),
+	polling(false),
+	captureThreadSettingsVersion(0),
+	appliedThreadSettingsVersion(0),
+	lastLivePollMicros(0),
+	configWatched(false),
+	configChangePending(false),
+	lastConfigInvalidation(0),
+	needToReconnect(false),
+	connectionErrors(0),
+	liveViewErrors(0),
+	liveViewResets(0),
+	liveViewRetryTime(0),
+	reinitAttempts(0),
+	state(STATE_CONNECTED),
+	stateEnteredTime(0),
+	retryTime(0),
+	busyBackoff(OFX_GPHOTO_MIN_BUSY_BACKOFF),
+	initializeSeconds(0),
+	stopRequested(false),
+	threadFinished(true),
+	sessionHandoff(false),
+	sessionHandedOff(false),
+	shutdownSeconds(0),
+	nextTransferId(1),
+	cancelRequested(false),
+	transferTimeout(0),
 	bytesPerFrame(0),
+	liveFrameCount(0),
+	focusSettle(0),
+	focusSpeculativeStep(0),
+	focusScoring(false),
+	focusLastScored(0),
+	focusScoreStart(0),
 	connected(false),
+	useLiveView(false),
 	liveDataReady(false),
 	frameNew(false),
-	needToTakePhoto(false),
 	photoNew(false),
-	useLiveView(false),
 	needToDecodePhoto(false),
 	needToUpdatePhoto(false),
 	photoDataReady(false),
 	needToSendKeepAlive(false),
 	needToDownloadImage(false),
-	resetIntervalMinutes(15) {
+	resetIntervalMinutes(15),
+	camera(nullptr),
+	cameracontext(nullptr),
+	tetherMode(false),
+	tetheredCount(0),
+	pendingTriggers(0),
+	triggerWindowEnd(0),
+	livePollSeconds(0),
+	shotTimingOpen(false),
+	shotStartMicros(0),
+	deletePolicy(DELETE_IMMEDIATE),
+	tetherDeletePolicy(DELETE_NEVER),
+	deletedCount(0),
+	deleteErrorCount(0),
+	deleteIdleDelay(.5),
+	lastPhotoTime(0) {
+	for(int i = 0; i < STATE_COUNT; i++) {
+		stateStats[i] = ConnectionStateStats();
+	}
+	shotTiming = ShotTiming();
+	lastConfigResult = ConfigResult();
+	focusSweepResult = FocusSweepResult();
+	captureThreadResult = ThreadSettingsResult();
 	liveBufferMiddle.resize(OFX_GPHOTO_BUFFER_SIZE);
 	for(size_t i = 0; i < liveBufferMiddle.maxSize(); i++) {
 		liveBufferMiddle[i] = new ofBuffer();
@@ -37,7 +129,82 @@ GPhoto::GPhoto() :
 	photoBuffer = new ofBuffer();
 }
 
-vector<CameraInformation> GPhoto::listDevices() const
+/*
+ Newer libgphoto2 names the widget in property change events, e.g.
+ PTP Property d101 changed, "shutterspeed" to "1/60". Returns "" for the older
+ ones that only give the property code.
+ */
+static string getChangedWidgetName(const char *event)
+{
+	const char *start = strstr(event, "changed, \"");
+	if(!start) {
+		return "";
+	}
+	start += strlen("changed, \"");
+	const char *end = strchr(start, '"');
+	return end ? string(start, end - start) : "";
+}
+
+/*
+ Opens a detected camera on its own context, reads what we want to know about
+ it and closes it again. Runs on a thread per camera from listDevices().
+ */
+static void probeCamera(CameraInformation& info)
+{
+	GPContext *context = gp_context_new();
+	Camera *camera = nullptr;
+
+	int ret = sampleOpenCamera(&camera, info.name.c_str(), info.port.c_str(), context);
+	if (ret >= GP_OK) {
+		ret = gp_camera_init(camera, context);
+	}
+	if (ret < GP_OK) {
+		// usually the camera is already claimed by a running GPhoto
+		ofLogWarning("ofxGphoto::listDevices") << "Cannot open " << info.name << " on " << info.port << " : " << gp_result_as_string(ret);
+	} else {
+		char *value = nullptr;
+		if (getConfigValueString(camera, "serialnumber", &value, context) >= GP_OK) {
+			info.serialNumber = value;
+			free(value);
+			rememberSerialPort(info.serialNumber, info.port);
+		}
+		value = nullptr;
+		if (getConfigValueString(camera, "cameramodel", &value, context) >= GP_OK) {
+			info.model = value;
+			free(value);
+		}
+		value = nullptr;
+		if (getConfigValueString(camera, "batterylevel", &value, context) >= GP_OK) {
+			info.batteryLevel = value;
+			free(value);
+		}
+
+		CameraStorageInformation *storage = nullptr;
+		int storageCount = 0;
+		if (gp_camera_get_storageinfo(camera, &storage, &storageCount, context) >= GP_OK) {
+			stringstream summary;
+			for (int i = 0; i < storageCount; i++) {
+				if (i > 0) {
+					summary << ", ";
+				}
+				summary << ((storage[i].fields & GP_STORAGEINFO_LABEL) ? storage[i].label : storage[i].basedir);
+				if ((storage[i].fields & GP_STORAGEINFO_FREESPACEKBYTES) && (storage[i].fields & GP_STORAGEINFO_MAXCAPACITY)) {
+					summary << " " << storage[i].freekbytes / 1024 << "/" << storage[i].capacitykbytes / 1024 << " MiB free";
+				}
+			}
+			info.storage = summary.str();
+			free(storage);
+		}
+		info.probed = true;
+		gp_camera_exit(camera, context);
+	}
+	if (camera) {
+		gp_camera_unref(camera);
+	}
+	gp_context_unref(context);
+}
+
+vector<CameraInformation> GPhoto::listDevices(bool probe) const
 {
 	vector<CameraInformation> info;
 
@@ -45,23 +212,19 @@ vector<CameraInformation> GPhoto::listDevices() const
 	context = gp_context_new();
 
 	CameraList	*list;
-	Camera		**cams;
-	int		ret, i, count;
+	int		i, count;
 	const char	*name, *value;
-	ret = gp_list_new (&list);
+	gp_list_new (&list);
 
 	// autodetect
-	gp_list_reset (list);
-	count = gp_camera_autodetect (list, context);
+	count = autodetectCameras (list, context);
 
 	if (count < GP_OK) {
 		ofLogNotice("ofxGphoto::listDevices") <<"No cameras detected.";
-		//return 1;
+		count = 0;
 	}
 
-	/* Now open all cameras we autodected for usage */
 	ofLogNotice("ofxGphoto::listDevices") << "Number of cameras : "<< count;
-	cams = (Camera**) calloc (sizeof(Camera*),count);
 	for (i = 0; i < count; i++) {
 		gp_list_get_name  (list, i, &name);
 		gp_list_get_value (list, i, &value);
@@ -70,14 +233,21 @@ vector<CameraInformation> GPhoto::listDevices() const
 		info.back().id = i;
 		info.back().name = name;
 		info.back().port = value;
-
-		char 		*serial;
-		ret = getConfigValueString(cams[i], "Serial Number", &serial, context);
-				if (ret >= GP_OK) {
-					info.back().serialNumber = serial;
-					free (serial);
-				}
-
+		info.back().probed = false;
+	}
+	gp_list_free(list);
+	gp_context_unref(context);
+
+	/* Now open all cameras we autodetected at the same time, so this takes as
+	   long as the slowest camera rather than all of them together */
+	if (probe) {
+		vector<std::thread> probes;
+		for (auto& camera:info) {
+			probes.emplace_back(probeCamera, ref(camera));
+		}
+		for (auto& p:probes) {
+			p.join();
+		}
 	}
 	return info;
 }
@@ -105,45 +275,324 @@ vector<CameraInformation> GPhoto::listDevices() const
 
 	void GPhoto::setup(int id)
 	{
+		if(!threadFinished || (sessionHandedOff && connected)) {
+			ofLogError("ofxGphoto::setup") << "the capture thread of the last session is still closing";
+			return;
+		}
 		initialize(id);
-		startCapture();
-		startThread();
+		startSession();
 	}
 
 	void GPhoto::setup(string cameraName)
 	{
-		bool found = false;
-		auto devices = listDevices();
-		for (auto& d:devices){
-			if(d.name == cameraName){
-				found = true;
-				setup(d.id);
-			}
+		setup(cameraName, MATCH_MODEL);
+	}
+
+	void GPhoto::setup(string value, MatchBy matchBy)
+	{
+		if(!threadFinished || (sessionHandedOff && connected)) {
+			ofLogError("ofxGphoto::setup") << "the capture thread of the last session is still closing";
+			return;
+		}
+		if(!initialize(value, matchBy) && matchBy == MATCH_MODEL) {
+			ofLogNotice("ofxGphoto::setup") << "device " << value << " not found. Using device with ID 0.";
+			initialize(0);
+		}
+		startSession();
+	}
+
+	void GPhoto::startSession()
+	{
+		if(!connected) {
+			setState(STATE_FAILED);
+		}
+		startCapture();
+		sessionHandedOff = false;
+		if(useOwnThread) {
+			threadFinished = false;
+			sessionHandoff = false;
+			startThread();
+		}
+	}
+
+	void GPhoto::setUseOwnThread(bool useOwnThread) {
+		this->useOwnThread = useOwnThread;
+	}
+
+	bool GPhoto::isUsingOwnThread() const {
+		return useOwnThread;
+	}
+
+	void GPhoto::setPolling(bool polling) {
+		this->polling = polling;
+	}
+
+	void GPhoto::poll(bool allowLiveView) {
+		lock_guard<std::timed_mutex> guard(pollMutex);
+		captureThreadId = this_thread::get_id();
+		captureLoop(allowLiveView);
+		if(sessionHandedOff.exchange(false)) {
+			// close() didn't wait for us
+			endSession();
 		}
-		if(!found){
-			ofLogNotice("ofxGphoto::setup") << "device " << cameraName << " not found. Using device with ID 0.";
-			setup(0);
+		captureThreadId = std::thread::id();
+	}
+
+	bool GPhoto::hasPendingPhotoWork() {
+		lock();
+		bool pending = commands.hasPending(COMMAND_FILE) || isWaitingForTrigger() || (!pendingDownloads.empty() && !photoNew);
+		unlock();
+		return pending;
+	}
+
+	bool GPhoto::popLiveFrame(ofBuffer& buffer) {
+		lock();
+		bool available = liveBufferMiddle.size() > 0;
+		if(available) {
+			std::swap(buffer, *liveBufferMiddle.front());
+			liveBufferMiddle.pop();
 		}
+		unlock();
+		return available;
+	}
+
+	unsigned int GPhoto::getLiveFrameCount() {
+		lock();
+		unsigned int count = liveFrameCount;
+		unlock();
+		return count;
+	}
+
+	float GPhoto::getBytesPerFrame() {
+		lock();
+		float bytes = bytesPerFrame;
+		unlock();
+		return bytes;
+	}
+
+	void GPhoto::setupBySerial(string serialNumber)
+	{
+		setup(serialNumber, MATCH_SERIAL);
+	}
+
+	void GPhoto::setupByPort(string port)
+	{
+		setup(port, MATCH_PORT);
 	}
 
+	const CameraInformation& GPhoto::getCameraInformation() const {
+		return cameraInformation;
+	}
+
+	/*
+	 Stops the capture thread through the stop token and joins it, instead of
+	 sleeping and hoping it is done. A call in flight is cancelled through the
+	 context, so this takes about as long as libgphoto2 needs to notice.
+
+	 Some calls don't poll the context. Releasing the camera under one would
+	 be worse than waiting, so after OFX_GPHOTO_SHUTDOWN_TIMEOUT_MS the thread
+	 is left to end the session itself once the call returns. Both sides set
+	 sessionHandoff, and whoever comes second ends the session. An outside
+	 poll() is waited for the same way through pollMutex, and ends the
+	 session when it finds it handed off.
+	 */
 	bool GPhoto::close() {
-		stopThread();
-		// for some reason waiting for the thread keeps it from
-		// completing, but sleeping then stopping capture is ok.
-		ofSleepMillis(100);
+		if(sessionHandedOff) {
+			// an earlier close() left the session to the capture thread
+			return !connected;
+		}
+		float startTime = ofGetElapsedTimef();
+		requestStop();
+		bool handedOff = false;
+		if(useOwnThread && !threadFinished) {
+			waitForThread(true, OFX_GPHOTO_SHUTDOWN_TIMEOUT_MS);
+			handedOff = !threadFinished && !sessionHandoff.exchange(true);
+			sessionHandedOff = handedOff;
+		}
+		bool sessionEnded = false;
+		unique_lock<std::timed_mutex> pollGuard(pollMutex, defer_lock);
+		if(!useOwnThread && !pollGuard.try_lock_for(chrono::milliseconds(OFX_GPHOTO_SHUTDOWN_TIMEOUT_MS))) {
+			sessionHandedOff = true;
+			if(pollGuard.try_lock()) {
+				// the poll finished meanwhile, and may have taken the session already
+				sessionEnded = !sessionHandedOff.exchange(false);
+			} else {
+				handedOff = true;
+			}
+		}
+		if(handedOff) {
+			ofLogError("ofxGphoto") << "Capture thread still busy after " << OFX_GPHOTO_SHUTDOWN_TIMEOUT_MS << " ms, it releases the camera when it is done";
+		} else if(!sessionEnded) {
+			endSession();
+		}
+		shutdownSeconds = ofGetElapsedTimef() - startTime;
+		ofLogVerbose("ofxGphoto") << "close took " << shutdownSeconds * 1000 << " ms";
+		return !handedOff;
+	}
+
+	void GPhoto::endSession() {
+		commands.cancelAll(GP_ERROR_CANCEL);
+		focusScorer.close();
+		// the last calls shouldn't be cancelled
+		stopRequested = false;
 		stopCapture();
-		return true;
+		clearTriggers();
+		liveAnalyzer.close();
+		// write out whatever is still queued
+		photoWriter.close();
+		finishShotTiming();
+		setShotTimingLog("");
+	}
+
+	void GPhoto::requestStop() {
+		stopRequested = true;
+	}
+
+	float GPhoto::getShutdownSeconds() const {
+		return shutdownSeconds;
+	}
+
+	void GPhoto::createContext() {
+		if (cameracontext) {
+			gp_context_unref(cameracontext);
+		}
+		cameracontext = gp_context_new();
+		gp_context_set_cancel_func(cameracontext, &GPhoto::cancelCallback, this);
+		gp_context_set_progress_funcs(cameracontext, &GPhoto::progressStartCallback,
+			&GPhoto::progressUpdateCallback, &GPhoto::progressStopCallback, this);
+		gp_context_set_status_func(cameracontext, &GPhoto::statusCallback, this);
+		gp_context_set_message_func(cameracontext, &GPhoto::statusCallback, this);
+		gp_context_set_error_func(cameracontext, &GPhoto::errorCallback, this);
+	}
+
+	GPContextFeedback GPhoto::cancelCallback(GPContext *, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		if(gphoto->stopRequested || gphoto->cancelRequested || gphoto->isTransferStale()) {
+			return GP_CONTEXT_FEEDBACK_CANCEL;
+		}
+		return GP_CONTEXT_FEEDBACK_OK;
+	}
+
+	bool GPhoto::isTransferStale() {
+		lock_guard<std::mutex> guard(progressMutex);
+		if(transferTimeout <= 0) {
+			return false;
+		}
+		float now = ofGetElapsedTimef();
+		for(auto& transfer:transfers) {
+			if(now - transfer.second.startTime > transferTimeout) {
+				ofLogWarning("ofxGphoto") << "Cancelling stale transfer: " << transfer.second.text;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	unsigned int GPhoto::progressStartCallback(GPContext *, float target, const char *text, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		TransferProgress progress;
+		{
+			lock_guard<std::mutex> guard(gphoto->progressMutex);
+			progress.id = gphoto->nextTransferId++;
+			progress.text = text ? text : "";
+			progress.target = target;
+			progress.current = 0;
+			progress.startTime = ofGetElapsedTimef();
+			progress.seconds = 0;
+			progress.finished = false;
+			gphoto->transfers[progress.id] = progress;
+		}
+		ofNotifyEvent(gphoto->transferProgress, progress);
+		return progress.id;
+	}
+
+	void GPhoto::progressUpdateCallback(GPContext *, unsigned int id, float current, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		TransferProgress progress;
+		{
+			lock_guard<std::mutex> guard(gphoto->progressMutex);
+			auto it = gphoto->transfers.find(id);
+			if(it == gphoto->transfers.end()) {
+				return;
+			}
+			it->second.current = current;
+			it->second.seconds = ofGetElapsedTimef() - it->second.startTime;
+			progress = it->second;
+		}
+		ofNotifyEvent(gphoto->transferProgress, progress);
+	}
+
+	void GPhoto::progressStopCallback(GPContext *, unsigned int id, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		TransferProgress progress;
+		{
+			lock_guard<std::mutex> guard(gphoto->progressMutex);
+			auto it = gphoto->transfers.find(id);
+			if(it == gphoto->transfers.end()) {
+				return;
+			}
+			progress = it->second;
+			gphoto->transfers.erase(it);
+		}
+		progress.seconds = ofGetElapsedTimef() - progress.startTime;
+		progress.finished = true;
+		ofNotifyEvent(gphoto->transferProgress, progress);
+	}
+
+	void GPhoto::statusCallback(GPContext *, const char *text, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		string message = text ? text : "";
+		ofLogVerbose("ofxGphoto") << message;
+		ofNotifyEvent(gphoto->statusMessage, message);
+	}
+
+	void GPhoto::errorCallback(GPContext *, const char *text, void *data) {
+		GPhoto *gphoto = (GPhoto*) data;
+		string message = text ? text : "";
+		ofLogError("ofxGphoto") << message;
+		ofNotifyEvent(gphoto->errorMessage, message);
+	}
+
+	vector<TransferProgress> GPhoto::getActiveTransfers() {
+		lock_guard<std::mutex> guard(progressMutex);
+		vector<TransferProgress> active;
+		float now = ofGetElapsedTimef();
+		for(auto& transfer:transfers) {
+			active.push_back(transfer.second);
+			active.back().seconds = now - transfer.second.startTime;
+		}
+		return active;
+	}
+
+	// cleared again at the start of the next capture loop, when the call is over
+	void GPhoto::cancelTransfers() {
+		cancelRequested = true;
+	}
+
+	void GPhoto::setTransferTimeout(float seconds) {
+		lock_guard<std::mutex> guard(progressMutex);
+		transferTimeout = seconds;
 	}
 
 	GPhoto::~GPhoto() {
-		if(connected) {
-			ofLogError() << "You must call close() before destroying the camera.";
+		if(!sessionHandedOff && (connected || !threadFinished)) {
+			if(connected) {
+				ofLogError() << "You must call close() before destroying the camera.";
+			}
+			close();
+		}
+		if(!threadFinished) {
+			// close() gave up on the thread, but it still uses everything we are about to free
+			waitForThread(false);
 		}
 		for(size_t i = 0; i < liveBufferMiddle.maxSize(); i++) {
 			delete liveBufferMiddle[i];
 		}
 		delete liveBufferFront;
 		delete liveBufferBack;
+		if(cameracontext) {
+			gp_context_unref(cameracontext);
+		}
 	}
 
 	void GPhoto::update() {
@@ -158,22 +607,242 @@ vector<CameraInformation> GPhoto::listDevices() const
 				//putBmpIntoPixels(*liveBufferFront, livePixels);
 				//ofLoadImage(livePixels, *liveBufferFront);
 				//livePixels.rotate90(orientationMode);
-				ofLoadImage(livePixels,*liveBufferFront);
-				if(liveTexture.getWidth() != livePixels.getWidth() ||
-						liveTexture.getHeight() != livePixels.getHeight()) {
-					liveTexture.allocate(livePixels.getWidth(), livePixels.getHeight(), GL_RGB8);
+				if(liveAnalyzer.isSetup()) {
+					// or on the analyzer's thread, we pick the result up below
+					liveAnalyzer.push(*liveBufferFront);
+				} else {
+					ofLoadImage(livePixels,*liveBufferFront);
+					updateLiveTexture();
 				}
-				liveTexture.loadData(livePixels);
 				//}
-
-				lock();
-				liveDataReady = true;
-				frameNew = true;
-				unlock();
 			} else {
 				unlock();
 			}
+			if(liveAnalyzer.isSetup() && liveAnalyzer.popFrame(livePixels)) {
+				updateLiveTexture();
+			}
+		}
+	}
+
+	void GPhoto::updateLiveTexture() {
+		if(liveTexture.getWidth() != livePixels.getWidth() ||
+				liveTexture.getHeight() != livePixels.getHeight()) {
+			liveTexture.allocate(livePixels.getWidth(), livePixels.getHeight(), GL_RGB8);
+		}
+		liveTexture.loadData(livePixels);
+		lock();
+		liveDataReady = true;
+		frameNew = true;
+		unlock();
+	}
+
+	void GPhoto::setLiveAnalysis(bool liveAnalysis) {
+		if(liveAnalysis && !liveAnalyzer.isSetup()) {
+			liveAnalyzer.setup();
+		} else if(!liveAnalysis) {
+			liveAnalyzer.close();
+		}
+	}
+
+	bool GPhoto::isLiveAnalysis() const {
+		return liveAnalyzer.isSetup();
+	}
+
+	LiveStats GPhoto::getLiveStats() {
+		return liveAnalyzer.getStats();
+	}
+
+	LiveAnalyzer& GPhoto::getLiveAnalyzer() {
+		return liveAnalyzer;
+	}
+
+	void GPhoto::setFocusAnalysis(bool focusAnalysis, int maskDownscale) {
+		liveAnalyzer.setFocusAnalysis(focusAnalysis, maskDownscale);
+		if(focusAnalysis) {
+			setLiveAnalysis(true);
+		}
+	}
+
+	float GPhoto::getLiveSharpness() {
+		return liveAnalyzer.getStats().sharpness;
+	}
+
+	bool GPhoto::getFocusMask(ofPixels& mask) {
+		return liveAnalyzer.getFocusMask(mask);
+	}
+
+	bool GPhoto::startFocusSweep(const FocusSweepSettings& settings) {
+		if(!useLiveView) {
+			ofLogError("ofxGphoto") << "Focus sweeps need the live view";
+			return false;
+		}
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		future<int> started = runCommand(COMMAND_CONFIG_SET, [this, settings] {
+			return beginFocusSweep(settings) ? GP_OK : GP_ERROR_NOT_SUPPORTED;
+		});
+		if(started.wait_for(chrono::seconds(5)) != future_status::ready) {
+			return false;
+		}
+		return started.get() >= GP_OK;
+	}
+
+	void GPhoto::cancelFocusSweep() {
+		runCommand(COMMAND_CONFIG_SET, [this] {
+			if(focusSweep.isRunning()) {
+				focusSweep.cancel();
+				endFocusSweep();
+			}
+			return GP_OK;
+		});
+	}
+
+	bool GPhoto::isFocusSweepRunning() {
+		lock();
+		bool running = focusSweepResult.running;
+		unlock();
+		return running;
+	}
+
+	FocusSweepResult GPhoto::getFocusSweepResult() {
+		lock();
+		FocusSweepResult result = focusSweepResult;
+		unlock();
+		return result;
+	}
+
+	/*
+	 Canon bodies offer "Near 1-3" and "Far 1-3" as choices, others a signed
+	 range. For a range the three step sizes are fractions of its extent.
+	 */
+	bool GPhoto::beginFocusSweep(const FocusSweepSettings& settings) {
+		if(focusSweep.isRunning()) {
+			return true;
+		}
+		{
+			lock_guard<std::mutex> guard(configMutex);
+			const ChoiceTable *table = configCache.getChoices("manualfocusdrive");
+			float min, max, increment;
+			if(table) {
+				for(int level = 1; level <= 3; level++) {
+					focusDriveValues[3 + level] = "Far " + ofToString(level);
+					focusDriveValues[3 - level] = "Near " + ofToString(level);
+					if(table->indexOf(focusDriveValues[3 + level]) < 0 || table->indexOf(focusDriveValues[3 - level]) < 0) {
+						ofLogError("ofxGphoto") << "Unknown manualfocusdrive choices";
+						return false;
+					}
+				}
+			} else if(configCache.getRange("manualfocusdrive", min, max, increment)) {
+				float extent = std::max(fabsf(min), fabsf(max));
+				float fractions[] = {1 / 128.f, 1 / 32.f, 1 / 8.f};
+				for(int level = 1; level <= 3; level++) {
+					focusDriveValues[3 + level] = ofToString(roundf(extent * fractions[level - 1]));
+					focusDriveValues[3 - level] = ofToString(-roundf(extent * fractions[level - 1]));
+				}
+			} else {
+				ofLogError("ofxGphoto") << "This camera has no manualfocusdrive";
+				return false;
+			}
+		}
+		focusScorer.setup();
+		focusScorer.setFocusAnalysis(true, 8);
+		focusScorer.setFocusRoi(settings.roi);
+		focusSweep.start(settings);
+		focusSettle = 0;
+		focusSpeculativeStep = 0;
+		focusScoring = false;
+		lock();
+		focusSweepResult = focusSweep.getResult();
+		unlock();
+		return true;
+	}
+
+	/*
+	 Called with every live frame while a sweep runs. A frame is only used
+	 once the lens has settled after the last step and the previous frame has
+	 been scored.
+	 */
+	void GPhoto::updateFocusSweep(const ofBuffer& frame) {
+		if(focusSettle > 0) {
+			focusSettle--;
+			return;
+		}
+		if(focusScoring) {
+			LiveStats stats = focusScorer.getStats();
+			if(stats.frame == focusLastScored) {
+				if(ofGetElapsedTimef() - focusScoreStart > 2) {
+					ofLogError("ofxGphoto") << "Focus sweep: live frames can't be scored";
+					focusSweep.cancel();
+					endFocusSweep();
+				}
+				return;
+			}
+			focusScoring = false;
+			int step = focusSweep.addScore(stats.sharpness);
+			lock();
+			focusSweepResult = focusSweep.getResult();
+			unlock();
+			if(step != focusSpeculativeStep) {
+				// this frame shows where the guess went, go where the sweep wants instead
+				if(focusSpeculativeStep != 0) {
+					driveFocus(-focusSpeculativeStep);
+					focusSpeculativeStep = 0;
+				}
+				if(step != 0 && driveFocus(step)) {
+					focusSettle = focusSweep.getSettings().settleFrames;
+				}
+				if(!focusSweep.isRunning()) {
+					endFocusSweep();
+				}
+				return;
+			}
+			focusSpeculativeStep = 0;
+			if(!focusSweep.isRunning()) {
+				endFocusSweep();
+				return;
+			}
+			// the guess was right, this frame already shows the next position
+		}
+
+		focusFrame = frame;
+		focusLastScored = focusScorer.getStats().frame;
+		focusScorer.push(focusFrame);
+		focusScoring = true;
+		focusScoreStart = ofGetElapsedTimef();
+
+		int guess = focusSweep.getExpectedStep();
+		if(guess != 0 && driveFocus(guess)) {
+			focusSpeculativeStep = guess;
+			focusSettle = focusSweep.getSettings().settleFrames;
+		}
+	}
+
+	bool GPhoto::driveFocus(int step) {
+		ConfigTransaction transaction;
+		transaction.set("manualfocusdrive", focusDriveValues[3 + step]);
+		if(!writeConfig(transaction, ofGetElapsedTimef()).success()) {
+			// most likely the end of the focus range
+			focusSweep.hitLimit();
+			return false;
+		}
+		return true;
+	}
+
+	void GPhoto::endFocusSweep() {
+		if(focusSpeculativeStep != 0) {
+			driveFocus(-focusSpeculativeStep);
+			focusSpeculativeStep = 0;
 		}
+		focusScorer.close();
+		focusScoring = false;
+		lock();
+		focusSweepResult = focusSweep.getResult();
+		FocusSweepResult result = focusSweepResult;
+		unlock();
+		ofLogVerbose("ofxGphoto") << "Focus sweep " << (result.converged ? "converged" : "stopped") << " after "
+			<< result.steps << " steps in " << result.seconds << "s";
+		ofNotifyEvent(focusSweepFinished, result);
 	}
 
 	bool GPhoto::isFrameNew() {
@@ -186,12 +855,11 @@ vector<CameraInformation> GPhoto::listDevices() const
 	}
 
 	bool GPhoto::isPhotoNew() {
-		if(photoNew) {
-			photoNew = false;
-			return true;
-		} else {
-			return false;
-		}
+		lock();
+		bool isNew = photoNew;
+		photoNew = false;
+		unlock();
+		return isNew;
 	}
 
 	float GPhoto::getFrameRate() {
@@ -210,13 +878,20 @@ vector<CameraInformation> GPhoto::listDevices() const
 	}
 
 	void GPhoto::takePhoto(bool blocking) {
-		lock();
-		needToTakePhoto = true;
-		unlock();
-		if(blocking) {
-			while(!photoNew) {
-				ofSleepMillis(10);
+		unsigned long long requestMicros = ofGetElapsedTimeMicros();
+		future<int> shot = runCommand(COMMAND_CAPTURE, [this, requestMicros] {
+			if(!connected) {
+				return GP_ERROR_IO;
+			}
+			beginShotTiming(requestMicros);
+			bool downloaded = shootAndDownloadPhoto(camera, cameracontext, &photoDownload);
+			if(downloaded) {
+				setPhotoReady();
 			}
+			return downloaded ? GP_OK : GP_ERROR;
+		});
+		if(blocking && shot.wait_for(chrono::milliseconds(OFX_GPHOTO_CAPTURE_TIMEOUT_MS)) != future_status::ready) {
+			ofLogWarning("ofxGphoto") << "Timed out waiting for the photo";
 		}
 	}
 
@@ -225,11 +900,21 @@ vector<CameraInformation> GPhoto::listDevices() const
 	}
 
 	const ofPixels& GPhoto::getPhotoPixels() const {
-		if(needToDecodePhoto) {
-			ofLoadImage(photoPixels, *photoBuffer);
-			// photoPixels.rotate90(orientationMode);
+		ofBuffer jpeg;
+		{
+			// the capture thread may hand over the next photo meanwhile, so decode a copy
+			lock_guard<std::mutex> guard(mutex);
+			if(!needToDecodePhoto) {
+				return photoPixels;
+			}
+			jpeg = *photoBuffer;
 			needToDecodePhoto = false;
 		}
+		ofLoadImage(photoPixels, jpeg);
+		// photoPixels.rotate90(orientationMode);
+		needToUpdatePhoto = true;
+		markShotTiming(&ShotTiming::decodedMs);
+		finishShotTiming();
 		return photoPixels;
 	}
 
@@ -307,6 +992,10 @@ vector<CameraInformation> GPhoto::listDevices() const
 
 				// copy picture from camera to buffer
 				buffer->set(liveData.ptr,liveData.size);
+				handleResult(GP_OK);
+				// only a good frame shows the live view works, other calls succeeding don't
+				liveViewErrors = 0;
+				liveViewResets = 0;
 
 				// free camera data
 				gp_file_unref(liveData.file);
@@ -314,7 +1003,14 @@ vector<CameraInformation> GPhoto::listDevices() const
 				return true;
 			}
 			else {
-				ofLogError("ofxGphoto") << "Getting camera preview - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+				// only the first failure in a row is worth an error, the state machine deals with the rest
+				if(liveViewErrors == 0 && liveViewResets == 0) {
+					ofLogError("ofxGphoto") << "Getting camera preview - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+				} else {
+					ofLogVerbose("ofxGphoto") << "Getting camera preview - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+				}
+				gp_file_unref(liveData.file);
+				handleResult(retval);
 				return false;
 			}
 		}
@@ -332,37 +1028,13 @@ vector<CameraInformation> GPhoto::listDevices() const
 			//force camera to take a picture
 			CameraFilePath camera_file_path;
 			int retval = gp_camera_capture(camera, GP_CAPTURE_IMAGE, &camera_file_path, cameracontext);
+			markShotTiming(&ShotTiming::capturedMs);
 			if(retval == GP_OK) {
-
-				//create new camerafile
-				gp_file_new(&photoData.file);
-
-				//download picture from camera to camerafile
-				retval = gp_camera_file_get(camera, camera_file_path.folder, camera_file_path.name,GP_FILE_TYPE_NORMAL, photoData.file, cameracontext);
-				if(retval == GP_OK) {
-					//get data and size of the picture
-					gp_file_get_data_and_size(photoData.file, &photoData.ptr, &photoData.size);
-
-					//copy picture to buffer
-					buffer->set(photoData.ptr,photoData.size);
-
-					// delete picture from camera
-					retval = gp_camera_file_delete(camera, camera_file_path.folder, camera_file_path.name,cameracontext);
-					if(retval != GP_OK) {
-						ofLogError("ofxGphoto") << "Cannot delete picture on camera."<< " : "<< retval<< "  "<< gp_result_as_string(retval)<<endl;
-					}
-
-					// free file
-					gp_file_free(photoData.file);
-					return true;
-				}
-				else {
-					ofLogError("ofxGphoto") << "Downloading camera photo - ERROR :: "<< retval<< "  "<< gp_result_as_string(retval)<<endl;
-					return false;
-				}
+				return downloadPhoto(camera, cameracontext, camera_file_path, buffer);
 			}
 			else {
 				ofLogError("ofxGphoto") << "Getting camera photo - ERROR : "<< retval<< "  "<< gp_result_as_string(retval)<<endl;
+				handleResult(retval);
 				return false;
 			}
 		}
@@ -372,93 +1044,1042 @@ vector<CameraInformation> GPhoto::listDevices() const
 		}
 	}
 
+	bool GPhoto::downloadPhoto(Camera *camera, GPContext *cameracontext, const CameraFilePath& camera_file_path, ofBuffer *buffer, bool tethered)
+	{
+		//create new camerafile
+		gp_file_new(&photoData.file);
+
+		//download picture from camera to camerafile
+		int retval = gp_camera_file_get(camera, camera_file_path.folder, camera_file_path.name,GP_FILE_TYPE_NORMAL, photoData.file, cameracontext);
+		if(retval == GP_OK) {
+			//get data and size of the picture
+			gp_file_get_data_and_size(photoData.file, &photoData.ptr, &photoData.size);
+
+			//copy picture to buffer
+			buffer->set(photoData.ptr,photoData.size);
+			handleResult(GP_OK);
+			markShotTiming(&ShotTiming::downloadedMs);
+
+			// delete picture from camera, now or later depending on the policy
+			handleDeletion(camera_file_path, tethered);
+			markShotTiming(&ShotTiming::deletedMs);
+
+			// free file
+			gp_file_free(photoData.file);
+			return true;
+		}
+		else {
+			ofLogError("ofxGphoto") << "Downloading camera photo - ERROR :: "<< retval<< "  "<< gp_result_as_string(retval)<<endl;
+			gp_file_free(photoData.file);
+			handleResult(retval);
+			return false;
+		}
+	}
 
-	bool GPhoto::savePhoto(string filename) {
-		return ofBufferToFile(filename, *photoBuffer, true);
-	}
-
-
-	void GPhoto::initialize(int id) {
-		connected = false;
-
-		GPContext *context;
-		context = gp_context_new();
+	/*
+	 Called from the capture thread once photoDownload holds a new photo. The
+	 download itself ran without the lock, here it only changes hands.
+	 */
+	void GPhoto::setPhotoReady() {
+		lock();
+		std::swap(*photoBuffer, photoDownload);
+		photoDataReady = true;
+		needToDecodePhoto = true;
+		needToDownloadImage = false;
+		photoNew = true;
+		unlock();
+	}
 
-		CameraList	*list;
-		Camera		**cams;
-		int		ret, count;
-		ret = gp_list_new (&list);
+	void GPhoto::setTetherMode(bool tetherMode) {
+		lock();
+		this->tetherMode = tetherMode;
+		unlock();
+	}
 
+	bool GPhoto::isTetherMode() const {
+		return tetherMode;
+	}
+
+	unsigned int GPhoto::getPendingDownloads() {
+		lock();
+		unsigned int pending = pendingDownloads.size();
+		unlock();
+		return pending;
+	}
+
+	unsigned int GPhoto::getTetheredCount() {
+		lock();
+		unsigned int count = tetheredCount;
+		unlock();
+		return count;
+	}
+
+	void GPhoto::startIntervalometer(float intervalSeconds, unsigned int count, float delaySeconds) {
+		lock();
+		scheduler.start(intervalSeconds, count, delaySeconds);
+		unlock();
+	}
+
+	void GPhoto::startBurst(unsigned int count, float intervalSeconds) {
+		startIntervalometer(intervalSeconds, count);
+	}
 
-		GPPortInfoList *port_info_list = nullptr;
-		CameraAbilitiesList *camera_abilities_list = nullptr;
+	void GPhoto::stopIntervalometer() {
+		lock();
+		scheduler.stop();
+		unlock();
+	}
 
+	bool GPhoto::isIntervalometerRunning() {
+		lock();
+		bool running = scheduler.isRunning();
+		unlock();
+		return running;
+	}
 
-    	gp_port_info_list_new(&port_info_list);
-    	gp_port_info_list_load(port_info_list);
+	SchedulerStats GPhoto::getIntervalometerStats() {
+		lock();
+		SchedulerStats stats = scheduler.getStats();
+		unlock();
+		return stats;
+	}
 
-    	gp_abilities_list_new(&camera_abilities_list);
-    	gp_abilities_list_load(camera_abilities_list, context);
+	/*
+	 The deadline only counts as done once the shutter fired. A failed trigger
+	 (e.g. busy writing the last file) is retried on the next loop, and when
+	 that's more than half an interval late the scheduler counts it as missed.
+	 */
+	void GPhoto::triggerScheduledShot() {
+		CaptureScheduler::Clock::time_point when = CaptureScheduler::Clock::now();
+		int retval = triggerCapture();
+		if(retval == GP_ERROR_NOT_SUPPORTED) {
+			// this driver can't trigger without downloading, fall back to a blocking capture
+			beginShotTiming(ofGetElapsedTimeMicros());
+			lock();
+			scheduler.fired(when);
+			unlock();
+			if(shootAndDownloadPhoto(camera, cameracontext, &photoDownload)) {
+				setPhotoReady();
+			}
+			return;
+		}
+		if(retval != GP_OK) {
+			ofLogError("ofxGphoto") << "Triggering scheduled photo - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+			return;
+		}
+		lock();
+		scheduler.fired(when);
+		unlock();
+	}
 
-		
+	future<int> GPhoto::submit(CommandType type, function<int(Camera*, GPContext*)> command) {
+		return runCommand(type, [this, command] {
+			if(!connected) {
+				return GP_ERROR_IO;
+			}
+			int retval = command(camera, cameracontext);
+			handleResult(retval);
+			return retval;
+		});
+	}
 
-		int num_cams = gp_camera_autodetect(list, context);
+	future<int> GPhoto::runCommand(CommandType type, CommandQueue::Command command) {
+		bool captureThread = this_thread::get_id() == captureThreadId;
+		if(!captureThread && sessionHandedOff) {
+			// close() gave up on a call that may still be running, the camera is off limits
+			promise<int> result;
+			result.set_value(GP_ERROR_IO);
+			return result.get_future();
+		}
+		if(!isLoopActive() || captureThread) {
+			promise<int> result;
+			result.set_value(command());
+			return result.get_future();
+		}
+		if(!isTakingCommands()) {
+			// nothing would run it until the camera is back, don't keep the caller waiting for that
+			promise<int> result;
+			result.set_value(GP_ERROR_IO);
+			return result.get_future();
+		}
+		return commands.push(type, move(command));
+	}
 
-		const char *name, *port;
+	// false while the camera is being reopened or has failed, which can take indefinitely
+	bool GPhoto::isTakingCommands() {
+		lock_guard<std::mutex> guard(stateMutex);
+		return state != STATE_REINITIALIZING && state != STATE_FAILED;
+	}
 
+	// whether a capture thread or an outside poll() is there to run commands
+	bool GPhoto::isLoopActive() {
+		if(useOwnThread) {
+			return isThreadRunning();
+		}
+		return polling || captureThreadId.load() != std::thread::id();
+	}
 
-		gp_list_get_name(list, id, &name);
-		gp_list_get_value(list, id, &port);
+	int GPhoto::triggerCapture() {
+		if(!connected) {
+			return GP_ERROR_IO;
+		}
+		int retval = gp_camera_trigger_capture(camera, cameracontext);
+		handleResult(retval);
+		if(retval == GP_OK) {
+			// the files are collected from the event queue by the capture loop
+			lock();
+			pendingTriggers++;
+			triggerWindowEnd = ofGetElapsedTimef() + OFX_GPHOTO_TRIGGER_FILE_WINDOW;
+			unlock();
+		}
+		return retval;
+	}
 
-		cams = (Camera**) calloc (sizeof(Camera*),2);
-		camera = cams[id];
-		gp_camera_new(&camera);
+	/*
+	 A trigger doesn't always bring a file (missed focus, full card), and RAW+JPEG
+	 bodies bring two. So every file within the window after the last trigger is
+	 taken, and once the window is over nothing counts as pending any more.
+	 Call this locked.
+	 */
+	bool GPhoto::isWaitingForTrigger() {
+		if(pendingTriggers > 0 && ofGetElapsedTimef() >= triggerWindowEnd) {
+			ofLogWarning("ofxGphoto") << pendingTriggers << " triggered shots never showed up on the card";
+			pendingTriggers = 0;
+		}
+		return pendingTriggers > 0;
+	}
 
+	void GPhoto::clearTriggers() {
+		lock();
+		pendingTriggers = 0;
+		triggerWindowEnd = 0;
+		unlock();
+	}
 
-		CameraAbilities abilities;
-		int model_index = gp_abilities_list_lookup_model(camera_abilities_list, name);
-		gp_abilities_list_get_abilities(camera_abilities_list, model_index, &abilities);
-		gp_camera_set_abilities(camera, abilities);
+	/*
+	 Drains the camera's event queue. The first wait uses the given timeout, after
+	 that we only pick up what is already there so the live view isn't held up.
+	 New files are remembered in pendingDownloads rather than downloaded here, so
+	 a burst from the camera's own shutter can't get lost while we are busy.
+	 */
+	void GPhoto::pollEvents(Camera *camera, GPContext *cameracontext, int timeoutMs)
+	{
+		int remaining = timeoutMs;
+		int timeout = min(remaining, OFX_GPHOTO_EVENT_SLICE_MS);
+		while(true) {
+			CameraEventType type;
+			void *data = nullptr;
+			int retval = gp_camera_wait_for_event(camera, timeout, &type, &data, cameracontext);
+			if(retval != GP_OK) {
+				ofLogError("ofxGphoto") << "Waiting for camera event - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+				free(data);
+				handleResult(retval);
+				return;
+			}
+			if(type == GP_EVENT_FILE_ADDED && data) {
+				CameraFilePath *path = (CameraFilePath*) data;
+				ofLogVerbose("ofxGphoto") << "new file on camera " << path->folder << "/" << path->name;
+				lock();
+				PendingDownload download;
+				download.path = *path;
+				download.triggered = ofGetElapsedTimef() < triggerWindowEnd;
+				if(tetherMode || download.triggered) {
+					pendingDownloads.push_back(download);
+				}
+				if(pendingTriggers > 0) {
+					pendingTriggers--;
+				}
+				unlock();
+			} else if(type == GP_EVENT_UNKNOWN && data && strstr((const char*) data, "PTP Property")) {
+				string name = getChangedWidgetName((const char*) data);
+				if(!name.empty()) {
+					lock_guard<std::mutex> guard(configMutex);
+					configCache.markStale(name);
+				} else {
+					// only the property code, we can't tell which key changed
+					configChangePending = true;
+				}
+			}
+			free(data);
+			if(type == GP_EVENT_TIMEOUT) {
+				// keep waiting slice by slice until something happened
+				remaining -= timeout;
+				if(remaining > 0 && !stopRequested) {
+					timeout = min(remaining, OFX_GPHOTO_EVENT_SLICE_MS);
+					continue;
+				}
+				return;
+			}
+			remaining = 0;
+			timeout = 0;
+		}
+	}
 
-		int port_index = gp_port_info_list_lookup_path(port_info_list, port);
+	ShotTiming GPhoto::getLastShotTiming() const {
+		lock_guard<std::mutex> guard(timingMutex);
+		if(shotTimingOpen || shotTimings.empty()) {
+			return shotTiming;
+		}
+		return shotTimings.back();
+	}
 
+	float GPhoto::getInitializeSeconds() const {
+		return initializeSeconds;
+	}
 
-		GPPortInfo port_info;
-		gp_port_info_list_get_info(port_info_list, port_index, &port_info);
-		gp_camera_set_port_info(camera, port_info);
+	deque<ShotTiming> GPhoto::getShotTimings() const {
+		lock_guard<std::mutex> guard(timingMutex);
+		return shotTimings;
+	}
 
-		int retval = gp_camera_init(camera, context);
-		
-		if (retval != GP_OK) {
-			ofLogError("ofxGphoto::setup") << "Camera initialisation error - " << retval << "   " << gp_result_as_string(retval)<<endl;
-		}else {
-			ofLogNotice("ofxGphoto::setup","Camera initialised successfully!");
-
-			// get camera information
-			CameraText	text;
-			retval = gp_camera_get_summary(camera,&text,cameracontext);
-			if (retval == GP_OK) {
-				ofLogNotice("ofxGphoto::setup") << "camera information";
-				ofLogNotice("=========================================");
-
-				ofBuffer cText(text.text,30*1024);
-				int count = 0;
-				for(auto& l:cText.getLines()){
-					ofLogNotice() << l;
-					if (count>=5){
-						break;
+	bool GPhoto::setShotTimingLog(string filename) {
+		lock_guard<std::mutex> guard(timingMutex);
+		if(shotTimingLog.is_open()) {
+			shotTimingLog.close();
+		}
+		if(filename.empty()) {
+			return true;
+		}
+		shotTimingLog.open(ofToDataPath(filename).c_str(), ios::out | ios::app);
+		if(!shotTimingLog.is_open()) {
+			ofLogError("ofxGphoto") << "Cannot open shot timing log " << filename;
+			return false;
+		}
+		if(shotTimingLog.tellp() == 0) {
+			shotTimingLog << "shot,requested_s,picked_up_ms,captured_ms,downloaded_ms,deleted_ms,decoded_ms" << endl;
+		}
+		return true;
+	}
+
+	// called from the capture thread when it starts working on a photo
+	void GPhoto::beginShotTiming(unsigned long long requestMicros) {
+		finishShotTiming();
+		lock_guard<std::mutex> guard(timingMutex);
+		unsigned int shot = shotTiming.shot + 1;
+		shotTiming = ShotTiming();
+		shotTiming.shot = shot;
+		shotTiming.requestedTime = requestMicros / 1000000.;
+		shotTiming.capturedMs = shotTiming.downloadedMs = shotTiming.deletedMs = shotTiming.decodedMs = -1;
+		shotStartMicros = requestMicros;
+		shotTimingOpen = true;
+		shotTiming.pickedUpMs = (ofGetElapsedTimeMicros() - shotStartMicros) / 1000.;
+	}
+
+	void GPhoto::markShotTiming(float ShotTiming::*stage) const {
+		lock_guard<std::mutex> guard(timingMutex);
+		if(shotTimingOpen) {
+			shotTiming.*stage = (ofGetElapsedTimeMicros() - shotStartMicros) / 1000.;
+		}
+	}
+
+	void GPhoto::finishShotTiming() const {
+		lock_guard<std::mutex> guard(timingMutex);
+		if(!shotTimingOpen) {
+			return;
+		}
+		shotTimingOpen = false;
+		shotTimings.push_back(shotTiming);
+		if(shotTimings.size() > OFX_GPHOTO_SHOT_TIMING_HISTORY) {
+			shotTimings.pop_front();
+		}
+		if(shotTimingLog.is_open()) {
+			const ShotTiming& t = shotTiming;
+			shotTimingLog << t.shot << "," << t.requestedTime << "," << t.pickedUpMs << "," << t.capturedMs << ","
+				<< t.downloadedMs << "," << t.deletedMs << "," << t.decodedMs << endl;
+		}
+	}
+
+	bool GPhoto::getConfigValue(const string& key, string& value) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getString(key, value);
+	}
+
+	string GPhoto::getConfigValue(const string& key) {
+		string value;
+		if(!getConfigValue(key, value)) {
+			ofLogWarning("ofxGphoto") << "No config value " << key;
+		}
+		return value;
+	}
+
+	vector<string> GPhoto::getConfigKeys() {
+		if(!ensureConfigCache()) {
+			return vector<string>();
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getKeys();
+	}
+
+	bool GPhoto::getConfigInt(const string& key, int& value) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getInt(key, value);
+	}
+
+	bool GPhoto::getConfigFloat(const string& key, float& value) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getFloat(key, value);
+	}
+
+	bool GPhoto::getConfigToggle(const string& key, bool& value) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getToggle(key, value);
+	}
+
+	bool GPhoto::getConfigRange(const string& key, float& min, float& max, float& increment) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getRange(key, min, max, increment);
+	}
+
+	vector<string> GPhoto::getConfigChoices(const string& key) {
+		if(!ensureConfigCache()) {
+			return vector<string>();
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		const ChoiceTable *table = configCache.getChoices(key);
+		return table ? table->choices : vector<string>();
+	}
+
+	int GPhoto::getConfigChoiceIndex(const string& key) {
+		if(!ensureConfigCache()) {
+			return -1;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return configCache.getChoiceIndex(key);
+	}
+
+	bool GPhoto::setConfigChoiceIndex(const string& key, int index, ConfigTransaction& transaction) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		const ChoiceTable *table = configCache.getChoices(key);
+		if(!table || index < 0 || index >= (int) table->choices.size()) {
+			return false;
+		}
+		transaction.set(key, table->choices[index]);
+		return true;
+	}
+
+	bool GPhoto::nextChoice(const string& key, ConfigTransaction& transaction, bool wrap) {
+		return stepChoice(key, 1, wrap, transaction);
+	}
+
+	bool GPhoto::prevChoice(const string& key, ConfigTransaction& transaction, bool wrap) {
+		return stepChoice(key, -1, wrap, transaction);
+	}
+
+	// false if there is nothing to step to
+	bool GPhoto::stepChoice(const string& key, int steps, bool wrap, ConfigTransaction& transaction) {
+		if(!ensureConfigCache()) {
+			return false;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		const ChoiceTable *table = configCache.getChoices(key);
+		if(!table || table->choices.empty()) {
+			return false;
+		}
+		string staged;
+		int current = transaction.get(key, staged) ? table->indexOf(staged) : configCache.getChoiceIndex(key);
+		if(current < 0) {
+			return false;
+		}
+		int count = table->choices.size();
+		int next = current + steps;
+		if(wrap) {
+			next = ((next % count) + count) % count;
+		} else {
+			next = ofClamp(next, 0, count - 1);
+		}
+		if(next == current) {
+			return false;
+		}
+		transaction.set(key, table->choices[next]);
+		return true;
+	}
+
+	void GPhoto::invalidateConfig() {
+		lock_guard<std::mutex> guard(configMutex);
+		configCache.markAllStale();
+	}
+
+	void GPhoto::invalidateConfig(const string& key) {
+		lock_guard<std::mutex> guard(configMutex);
+		configCache.markStale(key);
+	}
+
+	/*
+	 The widget tree may only be fetched by whoever drives the capture loop, so
+	 other threads queue a refresh and wait for it.
+	 */
+	bool GPhoto::ensureConfigCache() {
+		{
+			lock_guard<std::mutex> guard(configMutex);
+			if(!configCache.needsRefresh()) {
+				return true;
+			}
+		}
+		if(!connected) {
+			return false;
+		}
+		future<int> refreshed = runCommand(COMMAND_CONFIG_GET, [this] { return refreshConfig(); });
+		if(refreshed.wait_for(chrono::seconds(5)) != future_status::ready) {
+			ofLogWarning("ofxGphoto") << "Timed out reading config";
+			return false;
+		}
+		return refreshed.get() >= GP_OK;
+	}
+
+	/*
+	 Called by the thread that owns the camera, cheap if nothing is stale.
+	 configMutex is only held to take the stale keys and to bring the fresh
+	 values in, never while talking to the camera.
+	 */
+	int GPhoto::refreshConfig() {
+		bool all;
+		set<string> names;
+		{
+			lock_guard<std::mutex> guard(configMutex);
+			if(!connected) {
+				return GP_ERROR_IO;
+			}
+			if(!configCache.needsRefresh()) {
+				return GP_OK;
+			}
+			all = configCache.takeStale(names);
+		}
+		int retval = GP_OK;
+		for(auto& name:names) {
+			CameraWidget *fresh = nullptr;
+			retval = gp_camera_get_single_config(camera, name.c_str(), &fresh, cameracontext);
+			if(retval < GP_OK) {
+				// not every driver can read single widgets, fall back to the whole tree
+				all = true;
+				break;
+			}
+			lock_guard<std::mutex> guard(configMutex);
+			configCache.updateKey(name, fresh);
+			gp_widget_free(fresh);
+		}
+		if(all) {
+			ConfigCache fresh;
+			retval = fresh.load(camera, cameracontext);
+			lock_guard<std::mutex> guard(configMutex);
+			if(retval >= GP_OK) {
+				configCache.adopt(fresh);
+			} else {
+				// what we took is still stale, try again next time
+				configCache.markAllStale();
+			}
+		}
+		if(retval < GP_OK) {
+			handleResult(retval);
+		} else {
+			configWatched = true;
+		}
+		return retval;
+	}
+
+	/*
+	 Settings that trigger an action when they are written, rather than
+	 describe how the camera is set up. They don't belong in a preset.
+	 */
+	static const set<string> configActions = {
+		"viewfinder", "eosviewfinder", "eosremoterelease", "manualfocusdrive",
+		"autofocusdrive", "cancelautofocus", "capture", "bulb", "uilock", "popupflash"
+	};
+
+	ConfigPreset GPhoto::snapshotConfig() {
+		ConfigPreset preset;
+		if(!ensureConfigCache()) {
+			return preset;
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		for(auto& key:configCache.getKeys()) {
+			string value;
+			if(configActions.count(key) || !configCache.isWritable(key) || !configCache.getString(key, value)) {
+				continue;
+			}
+			preset.set(key, value);
+		}
+		return preset;
+	}
+
+	ConfigTransaction GPhoto::diffConfig(const ConfigPreset& preset) {
+		if(!ensureConfigCache()) {
+			return ConfigTransaction();
+		}
+		lock_guard<std::mutex> guard(configMutex);
+		return preset.diff(configCache);
+	}
+
+	bool GPhoto::applyPreset(const ConfigPreset& preset, bool blocking) {
+		ConfigTransaction transaction = diffConfig(preset);
+		if(transaction.empty()) {
+			return connected;
+		}
+		ofLogVerbose("ofxGphoto") << "Preset changes " << transaction.getChanges().size() << " settings";
+		return applyConfig(transaction, blocking);
+	}
+
+	bool GPhoto::applyConfig(const ConfigTransaction& transaction, bool blocking) {
+		if(transaction.empty()) {
+			return true;
+		}
+		if(!connected) {
+			return false;
+		}
+		float requestedTime = ofGetElapsedTimef();
+		future<int> written = runCommand(COMMAND_CONFIG_SET, [this, transaction, requestedTime] {
+			ConfigResult result = writeConfig(transaction, requestedTime);
+			ofNotifyEvent(configApplied, result);
+			if(result.result < GP_OK) {
+				return result.result;
+			}
+			return result.success() ? GP_OK : GP_ERROR_BAD_PARAMETERS;
+		});
+		if(!blocking && written.wait_for(chrono::seconds(0)) != future_status::ready) {
+			return true;
+		}
+		if(written.wait_for(chrono::seconds(5)) != future_status::ready) {
+			ofLogWarning("ofxGphoto") << "Timed out applying config";
+			return false;
+		}
+		return written.get() >= GP_OK;
+	}
+
+	ConfigResult GPhoto::getLastConfigResult() {
+		lock_guard<std::mutex> guard(configMutex);
+		return lastConfigResult;
+	}
+
+	/*
+	 Stages every value in the write tree and sends the whole tree in one
+	 gp_camera_set_config, so the camera sees a single round trip no matter
+	 how many settings change. Values the tree rejects (unknown key, read-only
+	 widget, not one of the choices) fail on their own without holding up the
+	 rest, after one more try on a freshly read tree in case the choices
+	 changed. If the camera refuses the write, the staged keys are re-read.
+
+	 The write tree is a copy of the config of its own, only touched by the
+	 thread that owns the camera, so libgphoto2 can work on it without
+	 configMutex and readers never see it half sent. Its values may be old,
+	 but only widgets marked as changed are sent, and every staged widget is
+	 unmarked again afterwards, whatever the outcome. The read cache gets the
+	 new values under the lock once the camera took them.
+	 */
+	ConfigResult GPhoto::writeConfig(const ConfigTransaction& transaction, float requestedTime) {
+		ConfigResult result;
+		result.result = connected ? GP_OK : GP_ERROR_IO;
+		bool loaded = false;
+		if(result.result >= GP_OK && !writeCache.hasTree()) {
+			result.result = writeCache.load(camera, cameracontext);
+			loaded = true;
+		}
+		bool staged = false;
+		if(result.result >= GP_OK) {
+			staged = stageConfig(transaction, result);
+			if(!loaded && !result.success() && writeCache.load(camera, cameracontext) >= GP_OK) {
+				result.results.clear();
+				staged = stageConfig(transaction, result);
+			}
+		}
+		if(staged) {
+			result.result = gp_camera_set_config(camera, writeCache.getRoot(), cameracontext);
+			lock_guard<std::mutex> guard(configMutex);
+			for(auto& r:result.results) {
+				if(r.second < GP_OK) {
+					continue;
+				}
+				writeCache.clearChanged(r.first);
+				string value;
+				if(result.result < GP_OK) {
+					r.second = result.result;
+					configCache.markStale(r.first);
+				} else if(transaction.get(r.first, value) && configCache.setString(r.first, value) >= GP_OK) {
+					configCache.clearChanged(r.first);
+				} else {
+					configCache.markStale(r.first);
+				}
+			}
+		}
+		if(staged && result.result < GP_OK) {
+			ofLogError("ofxGphoto") << "Could not apply config: " << gp_result_as_string(result.result);
+			handleResult(result.result);
+		}
+		result.latencyMs = (ofGetElapsedTimef() - requestedTime) * 1000;
+		lock_guard<std::mutex> guard(configMutex);
+		lastConfigResult = result;
+		return result;
+	}
+
+	bool GPhoto::stageConfig(const ConfigTransaction& transaction, ConfigResult& result) {
+		bool staged = false;
+		for(auto& change:transaction.getChanges()) {
+			int retval = writeCache.setString(change.first, change.second);
+			result.results.push_back(make_pair(change.first, retval));
+			staged = staged || retval >= GP_OK;
+		}
+		return staged;
+	}
+
+	void GPhoto::setDeletePolicy(DeletePolicy deletePolicy) {
+		lock();
+		this->deletePolicy = deletePolicy;
+		unlock();
+	}
+
+	DeletePolicy GPhoto::getDeletePolicy() const {
+		return deletePolicy;
+	}
+
+	void GPhoto::setTetherDeletePolicy(DeletePolicy deletePolicy) {
+		lock();
+		tetherDeletePolicy = deletePolicy;
+		unlock();
+	}
+
+	DeletePolicy GPhoto::getTetherDeletePolicy() const {
+		return tetherDeletePolicy;
+	}
+
+	void GPhoto::setDeleteIdleDelay(float seconds) {
+		deleteIdleDelay = seconds;
+	}
+
+	unsigned int GPhoto::getPendingDeletions() {
+		lock();
+		unsigned int pending = pendingDeletions.size();
+		unlock();
+		return pending;
+	}
+
+	unsigned int GPhoto::getDeletedCount() {
+		lock();
+		unsigned int deleted = deletedCount;
+		unlock();
+		return deleted;
+	}
+
+	unsigned int GPhoto::getDeleteErrorCount() {
+		lock();
+		unsigned int errors = deleteErrorCount;
+		unlock();
+		return errors;
+	}
+
+	// called from the capture thread right after a download
+	void GPhoto::handleDeletion(const CameraFilePath& path, bool tethered) {
+		lock();
+		lastPhotoTime = ofGetElapsedTimef();
+		DeletePolicy policy = tethered ? tetherDeletePolicy : deletePolicy;
+		if(policy == DELETE_DEFERRED || policy == DELETE_BATCHED) {
+			pendingDeletions.push_back(path);
+		}
+		unlock();
+		if(policy == DELETE_IMMEDIATE) {
+			int retval = gp_camera_file_delete(camera, path.folder, path.name, cameracontext);
+			lock();
+			if(retval == GP_OK) {
+				deletedCount++;
+			} else {
+				deleteErrorCount++;
+			}
+			unlock();
+			if(retval != GP_OK) {
+				ofLogError("ofxGphoto") << "Cannot delete picture on camera."<< " : "<< retval<< "  "<< gp_result_as_string(retval)<<endl;
+			}
+		}
+	}
+
+	/*
+	 Deletes queued files from the card. Unless drain is set, this only runs once
+	 the camera has been left alone for deleteIdleDelay seconds and handles a single
+	 entry per call, so a burst of shots or the live view never waits on more than
+	 one delete. With DELETE_BATCHED an entry is every queued file of one folder.
+	 Returns true if something was deleted.
+	 */
+	bool GPhoto::processDeletions(bool drain) {
+		bool deleted = false;
+		while(true) {
+			lock();
+			// a file that is on its way may land in the folder we are about to clear
+			bool filesPending = !pendingDownloads.empty() || isWaitingForTrigger();
+			DeletePolicy policy = deletePolicy;
+			if(pendingDeletions.empty() ||
+					(!drain && (commands.size(COMMAND_CAPTURE) > 0 || ofGetElapsedTimef() - lastPhotoTime < deleteIdleDelay ||
+						(policy == DELETE_BATCHED && filesPending)))) {
+				unlock();
+				break;
+			}
+			vector<CameraFilePath> batch;
+			batch.push_back(pendingDeletions.front());
+			pendingDeletions.pop_front();
+			if(policy == DELETE_BATCHED) {
+				for(auto it = pendingDeletions.begin(); it != pendingDeletions.end();) {
+					if(strcmp(it->folder, batch.front().folder) == 0) {
+						batch.push_back(*it);
+						it = pendingDeletions.erase(it);
+					} else {
+						++it;
+					}
+				}
+			}
+			unlock();
+
+			unsigned int deletedFiles = 0, errors = 0;
+			if(batch.size() > 1 && !filesPending && isFolderDownloaded(batch)) {
+				int retval = gp_camera_folder_delete_all(camera, batch.front().folder, cameracontext);
+				if(retval == GP_OK) {
+					deletedFiles = batch.size();
+				} else {
+					errors++;
+					ofLogError("ofxGphoto") << "Cannot delete " << batch.front().folder << "/* on camera : "
+						<< retval << "  " << gp_result_as_string(retval);
+				}
+			} else {
+				for(auto& path:batch) {
+					int retval = gp_camera_file_delete(camera, path.folder, path.name, cameracontext);
+					if(retval == GP_OK) {
+						deletedFiles++;
+					} else {
+						errors++;
+						ofLogError("ofxGphoto") << "Cannot delete " << path.folder << "/" << path.name
+							<< " on camera : " << retval << "  " << gp_result_as_string(retval);
 					}
-					++count;
 				}
+			}
+
+			lock();
+			deletedCount += deletedFiles;
+			deleteErrorCount += errors;
+			unlock();
+			deleted = deleted || deletedFiles > 0;
 
+			if(!drain) {
+				break;
 			}
-			else{
-				ofLogError("ofxGphoto::setup") << "Failed to get Camera information - " << retval << "   " << gp_result_as_string(retval)<<endl;
+		}
+		return deleted;
+	}
+
+	/*
+	 Whether the folder holds nothing but the given files, which we downloaded.
+	 Only then may it be cleared in one go, anything else on the card (older
+	 photos, shots that haven't been downloaded yet) has to stay.
+	 */
+	bool GPhoto::isFolderDownloaded(const vector<CameraFilePath>& files) {
+		CameraList *list;
+		gp_list_new(&list);
+		int retval = gp_camera_folder_list_files(camera, files.front().folder, list, cameracontext);
+		bool downloaded = retval == GP_OK;
+		int count = downloaded ? gp_list_count(list) : 0;
+		for(int i = 0; i < count && downloaded; i++) {
+			const char *name = nullptr;
+			gp_list_get_name(list, i, &name);
+			downloaded = false;
+			for(auto& file:files) {
+				if(name && strcmp(file.name, name) == 0) {
+					downloaded = true;
+					break;
+				}
 			}
-			connected = true;
+		}
+		gp_list_free(list);
+		return downloaded;
+	}
 
+	bool GPhoto::savePhoto(string filename) {
+		if(!photoWriter.isSetup()) {
+			photoWriter.setup();
 		}
+		lock();
+		bool queued = photoWriter.save(ofToDataPath(filename), *photoBuffer);
+		unlock();
+		return queued;
+	}
+
+	void GPhoto::setupPhotoWriter(int numThreads, size_t maxPendingBytes, SyncPolicy syncPolicy) {
+		photoWriter.setup(numThreads, maxPendingBytes, syncPolicy);
+	}
 
+	PhotoWriter& GPhoto::getPhotoWriter() {
+		return photoWriter;
+	}
+
+
+	void GPhoto::initialize(int id) {
+		connected = false;
+		float startTime = ofGetElapsedTimef();
+
+		createContext();
+
+		CameraList	*list;
+		gp_list_new (&list);
+
+		// the driver and port lists are shared with every other camera in the process
+		int count = autodetectCameras(list, cameracontext);
+		if (count <= id) {
+			ofLogError("ofxGphoto::setup") << "No camera with id " << id << ", " << max(count, 0) << " detected.";
+			gp_list_free(list);
+			return;
+		}
+
+		const char *name, *port;
+		gp_list_get_name(list, id, &name);
+		gp_list_get_value(list, id, &port);
+
+		int retval = openCamera(name, port);
+		if (retval == GP_OK) {
+			cameraInformation.id = id;
+			onCameraOpened();
+		}
+		gp_list_free(list);
+
+		initializeSeconds = ofGetElapsedTimef() - startTime;
+		ofLogNotice("ofxGphoto::setup") << "initialize took " << initializeSeconds * 1000 << " ms";
+	}
+
+	/*
+	 Picks a camera from a single detection pass. Model and port are matched on
+	 the autodetect list directly. For serial numbers the candidates are opened
+	 in turn, starting with the port the serial was last seen on, and the one
+	 that matches is kept open, so the winner doesn't have to be detected and
+	 initialised a second time. Every serial read on the way is remembered, so
+	 binding a whole rig by serial opens each camera about once.
+	 */
+	bool GPhoto::initialize(const string& value, MatchBy matchBy) {
+		connected = false;
+		float startTime = ofGetElapsedTimef();
+
+		createContext();
+
+		CameraList	*list;
+		gp_list_new (&list);
+		int count = autodetectCameras(list, cameracontext);
+
+		vector<int> candidates;
+		string rememberedPort = matchBy == MATCH_SERIAL ? getRememberedPort(value) : "";
+		for (int i = 0; i < count; i++) {
+			const char *port;
+			gp_list_get_value(list, i, &port);
+			if (!rememberedPort.empty() && rememberedPort == port) {
+				candidates.insert(candidates.begin(), i);
+			} else {
+				candidates.push_back(i);
+			}
+		}
+
+		for (int i:candidates) {
+			if (connected) {
+				break;
+			}
+			const char *name, *port;
+			gp_list_get_name(list, i, &name);
+			gp_list_get_value(list, i, &port);
+
+			if ((matchBy == MATCH_MODEL && value != name) || (matchBy == MATCH_PORT && value != port)) {
+				continue;
+			}
+			if (openCamera(name, port) != GP_OK) {
+				// most likely claimed by another GPhoto already
+				continue;
+			}
+			if (matchBy == MATCH_SERIAL) {
+				char *serial = nullptr;
+				bool match = false;
+				if (getConfigValueString(camera, "serialnumber", &serial, cameracontext) >= GP_OK) {
+					rememberSerialPort(serial, port);
+					match = value == serial;
+				}
+				free(serial);
+				if (!match) {
+					gp_camera_exit(camera, cameracontext);
+					gp_camera_unref(camera);
+					camera = nullptr;
+					continue;
+				}
+			}
+			cameraInformation.id = i;
+			onCameraOpened();
+		}
+		gp_list_free(list);
+
+		initializeSeconds = ofGetElapsedTimef() - startTime;
+		if (connected) {
+			ofLogNotice("ofxGphoto::setup") << "initialize took " << initializeSeconds * 1000 << " ms";
+		} else {
+			ofLogError("ofxGphoto::setup") << "No camera matching " << value << " among " << max(count, 0) << " detected.";
+		}
+		return connected;
+	}
+
+	// looks up driver and port in the shared lists and initialises the camera
+	int GPhoto::openCamera(const char *name, const char *port) {
+		cameraInformation = CameraInformation();
+		cameraInformation.name = name;
+		cameraInformation.port = port;
+
+		int retval = sampleOpenCamera(&camera, name, port, cameracontext);
+		if (retval == GP_OK) {
+			retval = gp_camera_init(camera, cameracontext);
+		}
+		if (retval != GP_OK) {
+			ofLogError("ofxGphoto::setup") << "Camera initialisation error - " << retval << "   " << gp_result_as_string(retval)<<endl;
+			if (camera) {
+				gp_camera_unref(camera);
+				camera = nullptr;
+			}
+		}
+		return retval;
+	}
+
+	void GPhoto::onCameraOpened() {
+		ofLogNotice("ofxGphoto::setup","Camera initialised successfully!");
+
+		char *serial = nullptr;
+		if (getConfigValueString(camera, "serialnumber", &serial, cameracontext) >= GP_OK) {
+			cameraInformation.serialNumber = serial;
+			rememberSerialPort(cameraInformation.serialNumber, cameraInformation.port);
+		}
+		free(serial);
+
+		// get camera information
+		CameraText	text;
+		int retval = gp_camera_get_summary(camera,&text,cameracontext);
+		if (retval == GP_OK) {
+			ofLogNotice("ofxGphoto::setup") << "camera information";
+			ofLogNotice("=========================================");
+
+			ofBuffer cText(text.text,30*1024);
+			int count = 0;
+			for(auto& l:cText.getLines()){
+				ofLogNotice() << l;
+				if (count>=5){
+					break;
+				}
+				++count;
+			}
+
+		}
+		else{
+			ofLogError("ofxGphoto::setup") << "Failed to get Camera information - " << retval << "   " << gp_result_as_string(retval)<<endl;
+		}
+		connected = true;
 	}
 
 	void GPhoto::startCapture() {
@@ -470,50 +2091,425 @@ vector<CameraInformation> GPhoto::listDevices() const
 		if(connected) {
 			setLiveView(false);
 
-			int retval = gp_camera_exit(camera, cameracontext);
-			if (retval != GP_OK) {
-				ofLogError("ofxGphoto::setup") << "Camera disconnection error - " << retval << "   " << gp_result_as_string(retval)<<endl;
-			}
-			else {
-				ofLogVerbose("ofxGphoto::setup","Camera disconnected successfully!");
-				connected = true;
+			// don't leave deferred deletes behind on the card
+			processDeletions(true);
+
+			releaseCamera();
+		}
+	}
+
+	void GPhoto::releaseCamera() {
+		int retval = gp_camera_exit(camera, cameracontext);
+		if (retval != GP_OK) {
+			ofLogError("ofxGphoto::setup") << "Camera disconnection error - " << retval << "   " << gp_result_as_string(retval)<<endl;
+		}
+		else {
+			ofLogVerbose("ofxGphoto::setup","Camera disconnected successfully!");
+		}
+		gp_camera_unref(camera);
+		camera = nullptr;
+		connected = false;
+		// whatever was triggered won't show up on this connection
+		clearTriggers();
 
+		writeCache.clear();
+		lock_guard<std::mutex> guard(configMutex);
+		configCache.clear();
+		configWatched = false;
+	}
+
+	/*
+	 Called from the capture thread with the result of every camera call, this
+	 drives the connection state machine:
+	 - busy: back off exponentially before the next call
+	 - timeouts and garbled data: reset the live view after a few without a good
+	   frame, reopen the camera if resets don't help and give up if that doesn't
+	   either
+	 - connection errors: reinitialize after a few in a row
+	 Anything else only fails the request that caused it.
+	 */
+	void GPhoto::handleResult(int retval) {
+		if(retval >= GP_OK) {
+			connectionErrors = 0;
+			busyBackoff = OFX_GPHOTO_MIN_BUSY_BACKOFF;
+			if(state == STATE_BUSY_BACKOFF) {
+				setState(STATE_CONNECTED);
+			}
+		} else if(retval == GP_ERROR_CAMERA_BUSY) {
+			setState(STATE_BUSY_BACKOFF);
+			retryTime = ofGetElapsedTimef() + busyBackoff;
+			busyBackoff = min(busyBackoff * 2, OFX_GPHOTO_MAX_BUSY_BACKOFF);
+		} else if(isConnectionError(retval)) {
+			if(++connectionErrors >= OFX_GPHOTO_MAX_CONNECTION_ERRORS) {
+				ofLogError("ofxGphoto") << cameraInformation.name << " on " << cameraInformation.port << " seems to be gone: " << gp_result_as_string(retval);
+				reinitAttempts = 0;
+				retryTime = 0;
+				setState(STATE_REINITIALIZING);
+			}
+		} else if(retval == GP_ERROR_TIMEOUT || retval == GP_ERROR_CORRUPTED_DATA || retval == GP_ERROR_CAMERA_ERROR) {
+			if(++liveViewErrors >= OFX_GPHOTO_MAX_LIVE_VIEW_ERRORS && useLiveView) {
+				setState(STATE_RESETTING_LIVE_VIEW);
 			}
 		}
 	}
 
-	void GPhoto::captureLoop() {
-		if(useLiveView && !needToTakePhoto) {
+	void GPhoto::setState(ConnectionState state) {
+		if(this->state == state) {
+			return;
+		}
+		float now = ofGetElapsedTimef();
+		{
+			// this can be called while the class is locked, so the stats have their own mutex
+			lock_guard<std::mutex> guard(stateMutex);
+			stateStats[this->state].seconds += now - stateEnteredTime;
+			stateStats[state].entered++;
+			this->state = state;
+			stateEnteredTime = now;
+		}
+		ofLogNotice("ofxGphoto") << cameraInformation.name << " is now " << getConnectionStateName(state);
+	}
+
+	ConnectionState GPhoto::getConnectionState() const {
+		return state;
+	}
+
+	ConnectionStateStats GPhoto::getConnectionStateStats(ConnectionState state) {
+		lock_guard<std::mutex> guard(stateMutex);
+		ConnectionStateStats stats = stateStats[state];
+		if(this->state == state) {
+			stats.seconds += ofGetElapsedTimef() - stateEnteredTime;
+		}
+		return stats;
+	}
+
+	string GPhoto::getConnectionStateName(ConnectionState state) {
+		switch(state) {
+			case STATE_CONNECTED: return "connected";
+			case STATE_BUSY_BACKOFF: return "busy";
+			case STATE_RESETTING_LIVE_VIEW: return "resetting live view";
+			case STATE_REINITIALIZING: return "reinitializing";
+			case STATE_FAILED: return "failed";
+			default: return "unknown";
+		}
+	}
+
+	/*
+	 Switches the viewfinder off, the next preview call switches it back on.
+	 Cameras without a viewfinder widget just keep going.
+	 */
+	void GPhoto::resetLiveView() {
+		CameraWidget *widget = nullptr;
+		int retval = gp_camera_get_single_config(camera, "viewfinder", &widget, cameracontext);
+		if(retval == GP_OK) {
+			int off = 0;
+			gp_widget_set_value(widget, &off);
+			retval = gp_camera_set_single_config(camera, "viewfinder", widget, cameracontext);
+			gp_widget_free(widget);
+		}
+		if(retval != GP_OK && retval != GP_ERROR_NOT_SUPPORTED && retval != GP_ERROR_BAD_PARAMETERS) {
+			ofLogWarning("ofxGphoto") << "Resetting live view - ERROR : "<< retval<< "  "<< gp_result_as_string(retval);
+		}
+		liveViewErrors = 0;
+		lastResetTime = ofGetElapsedTimef();
+	}
+
+	/*
+	 Runs at the top of every capture loop iteration. Returns false while the
+	 camera must be left alone.
+	 */
+	bool GPhoto::updateConnectionState() {
+		float now = ofGetElapsedTimef();
+		if(needToReconnect) {
+			reinitAttempts = 0;
+			liveViewResets = 0;
+			retryTime = 0;
+			setState(STATE_REINITIALIZING);
+			lock();
+			needToReconnect = false;
+			unlock();
+		}
+		switch(state) {
+			case STATE_CONNECTED:
+				if(useLiveView && now - lastResetTime > resetIntervalMinutes * 60) {
+					// the liveview needs to be reset every so often to avoid the camera turning off
+					resetLiveView();
+				}
+				return connected;
+			case STATE_BUSY_BACKOFF:
+				return now >= retryTime;
+			case STATE_RESETTING_LIVE_VIEW:
+				// resets that don't bring frames back escalate to reopening the camera, then to giving up
+				liveViewResets++;
+				if(liveViewResets >= 2 * OFX_GPHOTO_MAX_LIVE_VIEW_RESETS) {
+					ofLogError("ofxGphoto") << cameraInformation.name << ": the live view keeps failing, giving up";
+					// let isConnected() say so, a DeviceWatcher only retries cameras that aren't connected
+					releaseCamera();
+					setState(STATE_FAILED);
+					return false;
+				}
+				if(liveViewResets == OFX_GPHOTO_MAX_LIVE_VIEW_RESETS) {
+					ofLogWarning("ofxGphoto") << cameraInformation.name << ": resetting the live view doesn't help, reopening the camera";
+					reinitAttempts = 0;
+					retryTime = 0;
+					setState(STATE_REINITIALIZING);
+					return false;
+				}
+				resetLiveView();
+				liveViewRetryTime = now + OFX_GPHOTO_LIVE_VIEW_RESET_BACKOFF * liveViewResets;
+				setState(STATE_CONNECTED);
+				return true;
+			case STATE_REINITIALIZING:
+				if(now < retryTime) {
+					return false;
+				}
+				reconnect();
+				if(connected) {
+					setState(STATE_CONNECTED);
+					return true;
+				}
+				if(++reinitAttempts >= OFX_GPHOTO_MAX_REINIT_ATTEMPTS) {
+					setState(STATE_FAILED);
+				} else {
+					retryTime = now + reinitAttempts;
+				}
+				return false;
+			case STATE_FAILED:
+			default:
+				// wait for requestReconnect(), e.g. from a DeviceWatcher
+				return false;
+		}
+	}
+
+	void GPhoto::requestReconnect() {
+		lock();
+		needToReconnect = true;
+		unlock();
+	}
+
+	bool GPhoto::isReconnecting() {
+		lock();
+		bool reconnecting = needToReconnect;
+		unlock();
+		return reconnecting || state == STATE_REINITIALIZING;
+	}
+
+	/*
+	 Runs on the capture thread. A camera that comes back after a power cycle
+	 usually gets a new usb port, so we look for it by serial number when we know
+	 it and only fall back to the old port otherwise.
+	 */
+	void GPhoto::reconnect() {
+		if(connected) {
+			releaseCamera();
+		}
+		clearTriggers();
+		CameraInformation bound = cameraInformation;
+		ofLogNotice("ofxGphoto") << "Reconnecting " << bound.name << " " << bound.serialNumber;
+		if(!bound.serialNumber.empty()) {
+			initialize(bound.serialNumber, MATCH_SERIAL);
+		} else {
+			initialize(bound.port, MATCH_PORT);
+		}
+		if(!connected) {
+			// keep the binding for the next attempt
+			cameraInformation = bound;
+		}
+		connectionErrors = 0;
+		liveViewErrors = 0;
+	}
+
+	void GPhoto::captureLoop(bool allowLiveView) {
+		if(stopRequested) {
+			return;
+		}
+		cancelRequested = false;
+		if(!updateConnectionState()) {
+			if(!isTakingCommands()) {
+				// fail what was queued before the camera went away
+				commands.cancelAll(GP_ERROR_IO);
+			}
+			return;
+		}
+
+		// settings, shots and file work others asked for, most urgent first
+		while(commands.runNext(COMMAND_FILE)) {
+		}
+
+		lock();
+		CaptureScheduler::Clock::time_point now = CaptureScheduler::Clock::now();
+		bool shotDue = scheduler.isDue(now);
+		bool scheduled = scheduler.isRunning();
+		float secondsToDeadline = chrono::duration<float>(scheduler.getNextDeadline() - now).count();
+		// keep listening through the whole window, the second file of a pair comes late
+		bool waitForFiles = tetherMode || ofGetElapsedTimef() < triggerWindowEnd;
+		unlock();
+		// once settings have been read, keep an eye on change notifications as well
+		bool waitForConfigChanges = configWatched;
+
+		if(shotDue) {
+			triggerScheduledShot();
+		}
+
+		if(waitForFiles || waitForConfigChanges) {
+			// without live view the event wait doubles as the loop's sleep
+			int timeout = useLiveView || !waitForFiles ? 1 : 100;
+			if(scheduled) {
+				timeout = ofClamp(secondsToDeadline * 1000, 0, timeout);
+			}
+			pollEvents(camera, cameracontext, timeout);
+		}
+
+		// live view keeps some bodies sending change events, so don't drop the whole cache for each of them
+		float invalidateTime = ofGetElapsedTimef();
+		if(configChangePending && invalidateTime - lastConfigInvalidation >= OFX_GPHOTO_CONFIG_INVALIDATE_INTERVAL) {
+			lock_guard<std::mutex> guard(configMutex);
+			configCache.markAllStale();
+			configChangePending = false;
+			lastConfigInvalidation = invalidateTime;
+		}
+
+		// don't start a preview that would make the next scheduled shot late
+		bool deadlineNear = scheduled && secondsToDeadline < livePollSeconds * 1.5;
+		bool liveViewResting = ofGetElapsedTimef() < liveViewRetryTime;
+		if(useLiveView && allowLiveView && !commands.hasPending(COMMAND_FILE) && !deadlineNear && !liveViewResting) {
+			float livePollStart = ofGetElapsedTimef();
+			unsigned long long livePollMicros = ofGetElapsedTimeMicros();
 			if(updateLiveView(camera,cameracontext,liveBufferBack)){
+				livePollSeconds = ofLerp(livePollSeconds, ofGetElapsedTimef() - livePollStart, .1);
+				if(focusSweep.isRunning()) {
+					updateFocusSweep(*liveBufferBack);
+				}
 				lock();
+				if(lastLivePollMicros > 0) {
+					livePollJitter.add((livePollMicros - lastLivePollMicros) / 1000.f);
+				}
+				lastLivePollMicros = livePollMicros;
 				fps.tick();
-				bytesPerFrame = ofLerp(bytesPerFrame, liveBufferBack->size(), .01);
+				liveFrameCount++;
+				// start from the first frame's size rather than creeping up from 0
+				bytesPerFrame = bytesPerFrame == 0 ? liveBufferBack->size() : ofLerp(bytesPerFrame, liveBufferBack->size(), .01);
 				swap(liveBufferBack, liveBufferMiddle.back());
 				liveBufferMiddle.push();
 				unlock();
 			}
 		}
 
-		if(needToTakePhoto) {
-			lock();
-			shootAndDownloadPhoto(camera,cameracontext,photoBuffer);
-			needToTakePhoto = false;
-			photoDataReady = true;
-			needToDecodePhoto = true;
-			needToUpdatePhoto = true;
-			needToDownloadImage = false;
-			photoNew = true;
-			unlock();
+		// whatever asked to wait for the live view
+		commands.runNext(COMMAND_LIVE_VIEW);
+
+		// hand tethered shots over one at a time, the next one waits until
+		// the app has seen this one with isPhotoNew()
+		lock();
+		bool download = !pendingDownloads.empty() && !photoNew;
+		PendingDownload next;
+		if(download) {
+			next = pendingDownloads.front();
+			pendingDownloads.pop_front();
+		}
+		unlock();
 
+		if(download) {
+			beginShotTiming(ofGetElapsedTimeMicros());
+			if(downloadPhoto(camera, cameracontext, next.path, &photoDownload, !next.triggered)) {
+				lock();
+				tetheredCount++;
+				unlock();
+				setPhotoReady();
+			}
+		} else {
+			processDeletions(false);
 		}
 
 	}
 
+	// 5 ms from now, or earlier if a scheduled shot is due before that
+	CaptureScheduler::Clock::time_point GPhoto::getNextPollTime() {
+		CaptureScheduler::Clock::time_point wakeTime = CaptureScheduler::Clock::now() + chrono::milliseconds(5);
+		lock();
+		if(scheduler.isRunning() && scheduler.getNextDeadline() < wakeTime) {
+			wakeTime = scheduler.getNextDeadline();
+		}
+		unlock();
+		return wakeTime;
+	}
+
+	void GPhoto::setCaptureThreadSettings(const ThreadSettings& settings) {
+		if(!useOwnThread) {
+			ofLogWarning("ofxGphoto") << "setCaptureThreadSettings() only applies to the capture thread of setUseOwnThread(true)";
+		}
+		lock();
+		captureThreadSettings = settings;
+		captureThreadSettingsVersion++;
+		unlock();
+	}
+
+	void GPhoto::setDecodeThreadSettings(const ThreadSettings& settings) {
+		liveAnalyzer.setThreadSettings(settings);
+		focusScorer.setThreadSettings(settings);
+	}
+
+	ThreadSettingsResult GPhoto::getCaptureThreadResult() {
+		lock();
+		ThreadSettingsResult result = captureThreadResult;
+		unlock();
+		return result;
+	}
+
+	JitterReport GPhoto::getLivePollJitter() {
+		lock();
+		JitterReport report = livePollJitter.getReport();
+		unlock();
+		return report;
+	}
+
+	JitterReport GPhoto::getWakeJitter() {
+		lock();
+		JitterReport report = wakeJitter.getReport();
+		unlock();
+		return report;
+	}
+
+	void GPhoto::resetJitter() {
+		lock();
+		livePollJitter.reset();
+		wakeJitter.reset();
+		lastLivePollMicros = 0;
+		unlock();
+	}
+
+	// called from the capture thread, the settings are applied to whoever calls it
+	void GPhoto::applyCaptureThreadSettings() {
+		lock();
+		if(appliedThreadSettingsVersion == captureThreadSettingsVersion) {
+			unlock();
+			return;
+		}
+		ThreadSettings settings = captureThreadSettings;
+		appliedThreadSettingsVersion = captureThreadSettingsVersion;
+		unlock();
+		ThreadSettingsResult result = applyThreadSettings(settings, "ofxGphoto capture thread");
+		lock();
+		captureThreadResult = result;
+		unlock();
+	}
+
 	void GPhoto::threadedFunction() {
-		while(isThreadRunning()) {
+		captureThreadId = this_thread::get_id();
+		while(isThreadRunning() && !stopRequested) {
+			applyCaptureThreadSettings();
 			captureLoop();
-			ofSleepMillis(5);
+			CaptureScheduler::Clock::time_point wakeTime = getNextPollTime();
+			this_thread::sleep_until(wakeTime);
+			float lateMs = chrono::duration<float, milli>(CaptureScheduler::Clock::now() - wakeTime).count();
+			lock();
+			wakeJitter.add(lateMs);
+			unlock();
 		}
-
+		if(sessionHandoff.exchange(true)) {
+			// close() didn't wait for us
+			endSession();
+		}
+		captureThreadId = std::thread::id();
+		threadFinished = true;
 	}
 }
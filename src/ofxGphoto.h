@@ -9,9 +9,19 @@
 #include <gphoto2/gphoto2.h>
 #include "ofMain.h"
 #include "RateTimer.h"
+#include "CaptureScheduler.h"
 #include "FixedQueue.h"
 #include "FreeImage.h"
 #include "GphotoHelperFunctions.h"
+#include "PhotoWriter.h"
+#include "LiveAnalyzer.h"
+#include "FocusSweep.h"
+#include "ConfigCache.h"
+#include "ConfigTransaction.h"
+#include "ConfigPreset.h"
+#include "CommandQueue.h"
+#include "ThreadSettings.h"
+#include "JitterMeter.h"
 
 namespace ofxGphoto {
 
@@ -26,12 +36,85 @@ namespace ofxGphoto {
 		string name;
 		string port;
 		string serialNumber;
+		// only filled in when the camera could be opened while listing devices
+		bool probed;
+		string model;
+		string batteryLevel;
+		string storage; // short summary of the storage cards and their free space
+	};
+
+	/*
+	 The capture loop's view of the camera. Errors from libgphoto2 move it
+	 between these states, see GPhoto::handleResult().
+	 */
+	enum ConnectionState {
+		STATE_CONNECTED, // working normally
+		STATE_BUSY_BACKOFF, // the camera said it is busy, waiting before the next call
+		STATE_RESETTING_LIVE_VIEW, // previews time out or come back garbled
+		STATE_REINITIALIZING, // the connection is lost, reopening the camera
+		STATE_FAILED, // gave up, waiting for requestReconnect()
+		STATE_COUNT
+	};
+
+	struct ConnectionStateStats {
+		unsigned int entered; // how often the state was entered
+		float seconds; // total time spent in it
+	};
+
+	// what setup(string, MatchBy) compares against
+	enum MatchBy {
+		MATCH_MODEL, // camera model as reported by autodetection, e.g. "Nikon DSC D750"
+		MATCH_PORT, // port path, e.g. "usb:001,005"
+		MATCH_SERIAL // serial number, opens candidates until it finds the right one, starting with its last known port
+	};
+
+	/*
+	 Where the time goes for one photo. All stages are in milliseconds since the
+	 photo was requested with takePhoto(), -1 if the stage didn't happen (for
+	 tethered shots the clock starts when the download is picked up).
+	 */
+	struct ShotTiming {
+		unsigned int shot;
+		float requestedTime; // ofGetElapsedTimef() at the request
+		float pickedUpMs; // the capture thread started working on it
+		float capturedMs; // gp_camera_capture returned
+		float downloadedMs; // gp_camera_file_get finished and the data is copied
+		float deletedMs; // the delete policy has been applied
+		float decodedMs; // getPhotoPixels() decoded the jpeg
+	};
+
+	/*
+	 A long running libgphoto2 operation, usually a download. Units are
+	 whatever the driver reports, mostly bytes.
+	 */
+	struct TransferProgress {
+		unsigned int id;
+		string text; // what libgphoto2 says it is doing
+		float target;
+		float current;
+		float startTime; // ofGetElapsedTimef() when it started
+		float seconds; // how long it has been running
+		bool finished;
+		float getFraction() const { return target > 0 ? current / target : 0; }
+	};
+
+	/*
+	 What happens to a photo on the camera card once it has been downloaded.
+	 Deleting right away costs another USB round-trip before the next shot or
+	 live frame, so the deferred and batched policies postpone it until the
+	 capture loop is idle.
+	 */
+	enum DeletePolicy {
+		DELETE_IMMEDIATE, // delete each file right after downloading it (default)
+		DELETE_DEFERRED, // queue each file and delete it when the capture loop is idle
+		DELETE_BATCHED, // when idle, clear folders that only hold downloaded files with gp_camera_folder_delete_all
+		DELETE_NEVER // keep everything on the card
 	};
 	
 	class GPhoto : public ofThread {
 	public:
 		GPhoto();
-		vector<CameraInformation> listDevices() const;
+		vector<CameraInformation> listDevices(bool probe = true) const;
 		//void setDeviceId(int deviceId);
         void setOrientationMode(int orientationMode);
         void setLiveView(bool useLiveView);
@@ -39,7 +122,67 @@ namespace ofxGphoto {
 		void setup();
 		void setup(int id);
 		void setup(string cameraName);
-        bool close();
+		void setup(string value, MatchBy matchBy);
+		void setupBySerial(string serialNumber);
+		void setupByPort(string port);
+		const CameraInformation& getCameraInformation() const; // the camera this instance is bound to
+
+		/*
+		 By default every GPhoto runs its capture loop on its own thread. Call
+		 setUseOwnThread(false) before setup() to drive it from outside instead:
+		 poll() runs one capture loop iteration and getNextPollTime() says when the
+		 next one is due. Never call poll() from two threads at once.
+		 setPolling(true) while poll() is called regularly from a thread of its
+		 own, so camera calls from other threads are queued for the next poll
+		 rather than run alongside one. CameraRig does this for its cameras.
+		 */
+		void setUseOwnThread(bool useOwnThread);
+		bool isUsingOwnThread() const;
+		void setPolling(bool polling);
+		void poll(bool allowLiveView = true);
+		CaptureScheduler::Clock::time_point getNextPollTime();
+		bool hasPendingPhotoWork(); // a capture or download is waiting
+
+		/*
+		 Pin the capture thread and the live view decoders to cores, or ask for
+		 a real time policy or nice level, see ThreadSettings. The capture thread
+		 picks up changes at its next loop, the decoders with their next frame.
+		 The jitter reports show the effect: how regular the live view polls are
+		 and how late the capture thread wakes up from its sleep.
+		 */
+		void setCaptureThreadSettings(const ThreadSettings& settings); // only with our own thread
+		void setDecodeThreadSettings(const ThreadSettings& settings);
+		ThreadSettingsResult getCaptureThreadResult(); // what the capture thread was allowed to do
+		JitterReport getLivePollJitter(); // time between the starts of successful live view polls
+		JitterReport getWakeJitter(); // how late the capture thread woke up for its next loop
+		void resetJitter();
+		bool popLiveFrame(ofBuffer& buffer); // take the undecoded live jpeg instead of update()
+		unsigned int getLiveFrameCount();
+		float getBytesPerFrame();
+		// fire the shutter without waiting for the file, only while nothing else polls this camera
+		int triggerCapture();
+
+		/*
+		 Run any gphoto call on the capture thread, queued by type behind more
+		 urgent work. The future holds the call's result, GP_ERROR_CANCEL if the
+		 camera was closed first.
+		 */
+		future<int> submit(CommandType type, function<int(Camera*, GPContext*)> command);
+        bool close(); // false if the camera was still busy after 2 s, it is then released as soon as the call returns
+        void requestStop(); // cancel whatever the camera is doing, close() follows
+        float getShutdownSeconds() const; // how long the last close() took
+
+        /*
+         Feedback from the camera's context. The events are notified on the
+         capture thread while the camera call is still running, so listeners
+         must not wait for this GPhoto.
+         */
+        ofEvent<TransferProgress> transferProgress;
+        ofEvent<string> statusMessage; // status and messages from the driver
+        ofEvent<string> errorMessage;
+        vector<TransferProgress> getActiveTransfers();
+        void cancelTransfers(); // abort the calls that are in flight right now
+        void setTransferTimeout(float seconds); // abort transfers that take longer, 0 to wait forever
 		~GPhoto();
         
 		void update();
@@ -51,27 +194,242 @@ namespace ofxGphoto {
         void draw(float x, float y, float width, float height);
         const ofPixels& getLivePixels() const;
         const ofTexture& getLiveTexture() const;
+        /*
+         Live analysis moves decoding off the main thread, onto a worker that
+         also measures every frame. update() then only uploads the texture.
+         */
+        void setLiveAnalysis(bool liveAnalysis);
+        bool isLiveAnalysis() const;
+        LiveStats getLiveStats(); // histograms, means and clipping of the newest frame
+        LiveAnalyzer& getLiveAnalyzer(); // for the analyzed event, clipping levels and the focus roi
+        void setFocusAnalysis(bool focusAnalysis, int maskDownscale = 4); // turns on live analysis as well
+        float getLiveSharpness(); // gradient energy of the newest frame, -1 without focus analysis
+        bool getFocusMask(ofPixels& mask); // focus peaking edges, maskDownscale times smaller than the frame
+
+        /*
+         Contrast detect autofocus from the host: the capture thread drives
+         manualfocusdrive step by step and scores the live view after each
+         step. Needs the live view and a camera with manualfocusdrive.
+         */
+        bool startFocusSweep(const FocusSweepSettings& settings = FocusSweepSettings());
+        void cancelFocusSweep();
+        bool isFocusSweepRunning();
+        FocusSweepResult getFocusSweepResult();
+        ofEvent<FocusSweepResult> focusSweepFinished;
 		float getFrameRate();
         float getBandwidth();
         
-		void takePhoto(bool blocking = false);
+		void takePhoto(bool blocking = false); // blocking waits up to 30 s for the photo
 		bool isPhotoNew();
 		void drawPhoto(float x, float y);
 		void drawPhoto(float x, float y, float width, float height);
-        bool savePhoto(string filename); // .jpg only
+        bool savePhoto(string filename); // .jpg only, queued and written in the background
+        void setupPhotoWriter(int numThreads = 1, size_t maxPendingBytes = 256 << 20, SyncPolicy syncPolicy = SYNC_NONE);
+        PhotoWriter& getPhotoWriter(); // for the saved event and write statistics
         const ofPixels& getPhotoPixels() const;
         const ofTexture& getPhotoTexture() const;
 
         bool isConnected() { return connected; }
+        float getInitializeSeconds() const; // how long the last initialize took
+        void requestReconnect(); // reopen the bound camera on the capture thread
+        bool isReconnecting();
+        ConnectionState getConnectionState() const;
+        ConnectionStateStats getConnectionStateStats(ConnectionState state);
+        static string getConnectionStateName(ConnectionState state);
+
+		void setDeletePolicy(DeletePolicy deletePolicy);
+		DeletePolicy getDeletePolicy() const;
+		// photos taken with the camera's own shutter in tether mode, only downloaded into the photo buffer, so kept by default
+		void setTetherDeletePolicy(DeletePolicy deletePolicy);
+		DeletePolicy getTetherDeletePolicy() const;
+		void setDeleteIdleDelay(float seconds); // how long after a shot deferred deletes may start
+		unsigned int getPendingDeletions();
+		unsigned int getDeletedCount();
+		unsigned int getDeleteErrorCount();
+
+		/*
+		 Download photos taken with the camera's own shutter button. Tethered
+		 and intervalometer photos are handed over one at a time: the next
+		 download only starts once isPhotoNew() has returned true for the
+		 previous photo, so call it every frame. Until then new files wait on the
+		 card, getPendingDownloads() says how many.
+		 */
+		void setTetherMode(bool tetherMode);
+		bool isTetherMode() const;
+		unsigned int getPendingDownloads();
+		unsigned int getTetheredCount();
+
+		// timelapse and burst shooting, scheduled on the capture thread
+		void startIntervalometer(float intervalSeconds, unsigned int count = 0, float delaySeconds = 0);
+		void startBurst(unsigned int count, float intervalSeconds = 0);
+		void stopIntervalometer();
+		bool isIntervalometerRunning();
+		SchedulerStats getIntervalometerStats();
+
+		/*
+		 Camera settings, by widget name ("iso") or label ("ISO Speed"). The whole
+		 tree is read once and then served from memory, until it is invalidated
+		 explicitly or the camera reports a property change.
+		 */
+		bool getConfigValue(const string& key, string& value);
+		string getConfigValue(const string& key);
+		vector<string> getConfigKeys();
+		void invalidateConfig();
+		void invalidateConfig(const string& key); // only re-read this one widget
+
+		// typed settings, false if the widget doesn't exist or has another type
+		bool getConfigInt(const string& key, int& value);
+		bool getConfigFloat(const string& key, float& value);
+		bool getConfigToggle(const string& key, bool& value);
+		bool getConfigRange(const string& key, float& min, float& max, float& increment);
+		vector<string> getConfigChoices(const string& key); // radio and menu widgets
+		int getConfigChoiceIndex(const string& key); // -1 if not a choice
+
+		/*
+		 Stage a choice by index or relative to the current one. Stepping starts
+		 from what the transaction already holds for the key, so scrubbing a
+		 slider can step several times before the transaction is applied.
+		 */
+		bool setConfigChoiceIndex(const string& key, int index, ConfigTransaction& transaction);
+		bool nextChoice(const string& key, ConfigTransaction& transaction, bool wrap = false);
+		bool prevChoice(const string& key, ConfigTransaction& transaction, bool wrap = false);
+
+		/*
+		 Writes all settings of the transaction with one gp_camera_set_config on
+		 the capture thread, ahead of any pending shot. Non-blocking calls return
+		 once the transaction is queued and report through configApplied.
+		 */
+		bool applyConfig(const ConfigTransaction& transaction, bool blocking = false);
+		ConfigResult getLastConfigResult();
+
+		// presets: snapshot every writable setting, re-apply only what differs
+		ConfigPreset snapshotConfig();
+		ConfigTransaction diffConfig(const ConfigPreset& preset);
+		bool applyPreset(const ConfigPreset& preset, bool blocking = false);
+		ofEvent<ConfigResult> configApplied;
+
+		// per-shot latency breakdown of the capture pipeline
+		ShotTiming getLastShotTiming() const;
+		deque<ShotTiming> getShotTimings() const; // the most recent finished shots
+		bool setShotTimingLog(string filename); // append every shot as a csv row, "" to stop
         
 	private:
 		void initialize(int id);
+		void startSession();
+		bool useOwnThread;
+		atomic<std::thread::id> captureThreadId; // whoever is running the capture loop right now
+		atomic<bool> polling;
+		ThreadSettings captureThreadSettings;
+		ThreadSettingsResult captureThreadResult;
+		unsigned int captureThreadSettingsVersion;
+		unsigned int appliedThreadSettingsVersion; // only touched by the capture thread
+		void applyCaptureThreadSettings();
+		JitterMeter livePollJitter;
+		JitterMeter wakeJitter;
+		unsigned long long lastLivePollMicros;
+
+		/*
+		 Everything other threads want from the camera goes through commands and
+		 is run by the capture loop. runCommand() calls directly instead when we
+		 already are the capture thread, or nobody drives the loop. While the
+		 camera is reinitializing or has failed, commands fail with GP_ERROR_IO
+		 instead of waiting.
+		 */
+		CommandQueue commands;
+		future<int> runCommand(CommandType type, CommandQueue::Command command);
+		bool isLoopActive();
+		bool isTakingCommands();
+
+		/*
+		 The config cache is guarded by configMutex, and only refreshed or
+		 written by COMMAND_CONFIG_GET and COMMAND_CONFIG_SET commands. The
+		 mutex is never held across a round trip to the camera. Writes are
+		 staged in writeCache, which only the camera's thread touches.
+		 configWatched makes the loop listen for property change events once
+		 there is something to invalidate.
+		 */
+		ConfigCache configCache;
+		std::mutex configMutex;
+		bool configWatched;
+		bool configChangePending; // an unnamed property changed, only touched by the capture thread
+		float lastConfigInvalidation;
+		bool ensureConfigCache();
+		int refreshConfig();
+		bool stepChoice(const string& key, int steps, bool wrap, ConfigTransaction& transaction);
+		ConfigResult lastConfigResult;
+		ConfigResult writeConfig(const ConfigTransaction& transaction, float requestedTime);
+		ConfigCache writeCache;
+		bool stageConfig(const ConfigTransaction& transaction, ConfigResult& result);
+		bool initialize(const string& value, MatchBy matchBy);
+		int openCamera(const char *name, const char *port);
+		void onCameraOpened();
+		CameraInformation cameraInformation;
+
+		/*
+		 Every camera call reports its result to handleResult(), which moves the
+		 connection state machine. updateConnectionState() runs the current state
+		 at the top of the capture loop and keeps the loop away from the camera
+		 while it backs off, reinitializes or has failed. Only the capture thread
+		 changes the state, transitions are counted under stateMutex.
+		 */
+		bool needToReconnect;
+		unsigned int connectionErrors;
+		unsigned int liveViewErrors;
+		unsigned int liveViewResets; // since the last good live frame
+		float liveViewRetryTime; // no previews before this, after a reset
+		unsigned int reinitAttempts;
+		ConnectionState state;
+		ConnectionStateStats stateStats[STATE_COUNT];
+		std::mutex stateMutex;
+		float stateEnteredTime;
+		float retryTime;
+		float busyBackoff;
+		void releaseCamera();
+		void handleResult(int retval);
+		void setState(ConnectionState state);
+		bool updateConnectionState();
+		void resetLiveView();
+		void reconnect();
+		float initializeSeconds;
+
+		/*
+		 stopRequested is the stop token: the capture loop leaves at the next
+		 check and libgphoto2 polls it through the context's cancel function,
+		 so downloads and other long calls give up early.
+		 */
+		atomic<bool> stopRequested;
+		atomic<bool> threadFinished;
+		atomic<bool> sessionHandoff; // set by close() giving up and by the exiting capture thread
+		atomic<bool> sessionHandedOff; // close() gave up waiting, until the next setup() or the poll() that ends the session
+		std::timed_mutex pollMutex; // held by poll() while it runs the loop
+		float shutdownSeconds;
+		void endSession();
+		void createContext();
+		static GPContextFeedback cancelCallback(GPContext *context, void *data);
+
+		/*
+		 The context belongs to this GPhoto and reports back through these
+		 callbacks. Running transfers are tracked under progressMutex, which the
+		 cancel callback also checks for cancelTransfers() and the timeout.
+		 */
+		std::mutex progressMutex;
+		map<unsigned int, TransferProgress> transfers;
+		unsigned int nextTransferId;
+		atomic<bool> cancelRequested;
+		float transferTimeout;
+		static unsigned int progressStartCallback(GPContext *context, float target, const char *text, void *data);
+		static void progressUpdateCallback(GPContext *context, unsigned int id, float current, void *data);
+		static void progressStopCallback(GPContext *context, unsigned int id, void *data);
+		static void statusCallback(GPContext *context, const char *text, void *data);
+		static void errorCallback(GPContext *context, const char *text, void *data);
+		bool isTransferStale();
         void startCapture();
-        void captureLoop();
+        void captureLoop(bool allowLiveView = true);
         void stopCapture();
 		
 		RateTimer fps;
         float bytesPerFrame;
+		unsigned int liveFrameCount;
 		
 		/*
 		 Live view data is read from the camera into liveBufferBack when DownloadEvfData()
@@ -90,15 +448,46 @@ namespace ofxGphoto {
 		vector<FIBITMAP*> buffers;
 		
 		/*
-		 Photo data is read from the camera into photoBuffer when downloadImage() is
-		 called after being triggered by takePhoto(). photoBuffer is only decoded
-		 into photoPixels when getPhotoPixels() is called. drawPhoto() will call
-		 getPhotoPixels(), and also upload photoPixels to photoTexture. savePhoto()
-		 does not decode photoBuffer.
+		 Photo data is read from the camera into photoDownload without holding the
+		 lock, and swapped into photoBuffer under lock() once it is complete.
+		 photoBuffer is only decoded into photoPixels when getPhotoPixels() is
+		 called. drawPhoto() will call getPhotoPixels(), and also upload
+		 photoPixels to photoTexture. savePhoto() does not decode photoBuffer.
 		 */
 		ofBuffer *photoBuffer;
+		ofBuffer photoDownload; // only touched by the capture thread
 		mutable ofPixels photoPixels;
 		mutable ofTexture photoTexture;
+
+		/*
+		 savePhoto() copies photoBuffer into the writer queue and returns, the file
+		 is written on the writer's own thread(s).
+		 */
+		PhotoWriter photoWriter;
+		LiveAnalyzer liveAnalyzer;
+		void updateLiveTexture();
+
+		/*
+		 The focus sweep lives on the capture thread. Each scored frame goes to
+		 focusScorer, and while it is decoded and scored the lens already takes
+		 the step the sweep will most likely ask for (focusSpeculativeStep). If
+		 the sweep decides differently, that step is undone. Other threads only
+		 see focusSweepResult, under lock().
+		 */
+		FocusSweep focusSweep;
+		FocusSweepResult focusSweepResult;
+		LiveAnalyzer focusScorer;
+		string focusDriveValues[7]; // manualfocusdrive values for steps -3..3
+		ofBuffer focusFrame;
+		int focusSettle;
+		int focusSpeculativeStep;
+		bool focusScoring;
+		unsigned int focusLastScored;
+		float focusScoreStart;
+		bool beginFocusSweep(const FocusSweepSettings& settings);
+		void updateFocusSweep(const ofBuffer& frame);
+		bool driveFocus(int step);
+		void endFocusSweep();
 		
 		/*
 		 There are a few important state variables used for keeping track of what
@@ -109,7 +498,6 @@ namespace ofxGphoto {
         bool useLiveView; // Whether to initialize live view on setup().
 		bool liveDataReady; // Live view data has been downloaded at least once by threadedFunction().
 		bool frameNew; // There has been a new frame since the user last checked isFrameNew().
-		bool needToTakePhoto; // threadedFunction() should take a picture next chance it gets.
 		bool photoNew; // There is a new photo since the user last checked isPhotoNew().
 		mutable bool needToDecodePhoto; // The photo pixels needs to be decoded from photo buffer.
 		mutable bool needToUpdatePhoto; // The photo texture needs to be updated from photo pixels.
@@ -143,5 +531,70 @@ namespace ofxGphoto {
 
 		bool updateLiveView(Camera *camera, GPContext *cameracontext,ofBuffer *buffer);
 		bool shootAndDownloadPhoto(Camera *camera, GPContext *cameracontext,ofBuffer *buffer);
+		bool downloadPhoto(Camera *camera, GPContext *cameracontext, const CameraFilePath& path, ofBuffer *buffer, bool tethered = false);
+		void setPhotoReady();
+
+		/*
+		 In tether mode the capture loop interleaves gp_camera_wait_for_event with
+		 the live view. Every GP_EVENT_FILE_ADDED is queued in pendingDownloads and
+		 downloaded into photoBuffer as if takePhoto() had been called. Files that
+		 didn't come from our own triggers fall under tetherDeletePolicy.
+		 */
+		struct PendingDownload {
+			CameraFilePath path;
+			bool triggered; // one of our shots rather than the camera's shutter button
+		};
+		bool tetherMode;
+		deque<PendingDownload> pendingDownloads;
+		unsigned int tetheredCount;
+		void pollEvents(Camera *camera, GPContext *cameracontext, int timeoutMs);
+
+		/*
+		 The intervalometer fires gp_camera_trigger_capture at absolute deadlines and
+		 collects the resulting files through the same event queue as tether mode,
+		 so downloads overlap with waiting for the next deadline. The live view is
+		 skipped when a preview poll would run into the next deadline.
+		 */
+		CaptureScheduler scheduler;
+		unsigned int pendingTriggers; // triggered shots whose files haven't shown up yet
+		float triggerWindowEnd; // files that show up before this belong to our triggers
+		bool isWaitingForTrigger();
+		void clearTriggers();
+		float livePollSeconds; // smoothed duration of one gp_camera_capture_preview
+		void triggerScheduledShot();
+
+		/*
+		 A shot's timing stays open until its photo is decoded or the next shot
+		 starts, then it is moved to shotTimings and written to the csv log. It is
+		 filled in from both threads, so it has its own mutex.
+		 */
+		mutable std::mutex timingMutex;
+		mutable ShotTiming shotTiming;
+		mutable bool shotTimingOpen;
+		mutable deque<ShotTiming> shotTimings;
+		mutable ofstream shotTimingLog;
+		unsigned long long shotStartMicros;
+		void beginShotTiming(unsigned long long requestMicros);
+		void markShotTiming(float ShotTiming::*stage) const;
+		void finishShotTiming() const;
+
+		/*
+		 Files waiting to be deleted from the card. With DELETE_BATCHED the files of
+		 one folder are deleted together, which falls back to one delete per file
+		 when the folder holds anything we didn't download. The queue is filled and
+		 drained by the capture thread, the counters are read from the main thread
+		 under lock().
+		 */
+		DeletePolicy deletePolicy;
+		DeletePolicy tetherDeletePolicy;
+		deque<CameraFilePath> pendingDeletions;
+		unsigned int deletedCount;
+		unsigned int deleteErrorCount;
+		float deleteIdleDelay;
+		float lastPhotoTime;
+
+		void handleDeletion(const CameraFilePath& path, bool tethered);
+		bool processDeletions(bool drain);
+		bool isFolderDownloaded(const vector<CameraFilePath>& files);
 	};
 }